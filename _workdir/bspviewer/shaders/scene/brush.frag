@@ -17,7 +17,15 @@ uniform vec3 u_vFxColor;
 #endif
 
 vec3 sampleLightmap(int i, float scale) {
-	vec3 lightmapColor = texture(u_LMTexture, vec3(vsOut.vLMTexCoord, i)).rgb;
+	int layer = u_Global.viLMLayers[i];
+
+	if (layer >= 0) {
+		layer += int(vsOut.vLMTexCoord.z + 0.5) * u_Global.uiLMPageLayers;
+	} else {
+		layer = u_Global.uiLMBlackLayer;
+	}
+
+	vec3 lightmapColor = texture(u_LMTexture, vec3(vsOut.vLMTexCoord.xy, layer)).rgb;
 	return pow(lightmapColor.rgb, vec3(u_Global.uflLMGamma)) * scale;
 }
 
@@ -6,7 +6,7 @@ IFACE_VF ShaderIface {
 	vec3 vNormal;			// World-space normal vector
 	vec2 vTexCoord;			// Texture coordinates
 	vec4 vLightstyleScale;	// Lightstyle intensity
-	vec2 vLMTexCoord;		// Lightmap texture coordinates
+	vec3 vLMTexCoord;		// Lightmap texture coordinates (xy) and page (z)
 
 #ifdef SUPPORT_TINTING
 	vec4 vTintColor;		// Surface tint color
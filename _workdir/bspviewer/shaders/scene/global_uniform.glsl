@@ -9,7 +9,8 @@ layout (std140) uniform GlobalUniform {
     vec4 vMainViewOrigin; // xyz
     vec4 vflParams1;      // x tex gamma, y screen gamma, z sim time, w sim time delta
     vec4 vflParams2;      // x lightmap gamma
-    ivec4 viParams1;      // x is texture type, y is lighting type
+    ivec4 viParams1;      // x tex type, y lighting type, z LM page layers, w LM black layer
+    ivec4 viLMLayers;     // LM page layer of each lightstyle slot or -1 for black layer
 } u_Global;
 
 #define uflTexGamma     vflParams1.x
@@ -19,5 +20,7 @@ layout (std140) uniform GlobalUniform {
 #define uflLMGamma      vflParams2.x
 #define uiTextureType   viParams1.x
 #define uiLightingType  viParams1.y
+#define uiLMPageLayers  viParams1.z
+#define uiLMBlackLayer  viParams1.w
 
 #endif
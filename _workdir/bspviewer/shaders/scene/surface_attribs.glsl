@@ -13,8 +13,8 @@ layout (location = 2) in vec2 inTexCoord;
 // Lightstyle index
 layout (location = 3) in ivec4 inLightStyle;
 
-// Lightmap texture coordinates
-layout (location = 4) in vec2 inLMTexCoord;
+// Lightmap texture coordinates (xy) and page (z)
+layout (location = 4) in vec3 inLMTexCoord;
 
 #ifdef SUPPORT_TINTING
 // Tint color
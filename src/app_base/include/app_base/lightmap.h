@@ -1,19 +1,38 @@
 #ifndef APP_BASE_LIGHTMAP_H
 #define APP_BASE_LIGHTMAP_H
+#include <cstdint>
+#include <cstddef>
 
 struct LightmapFileFormat {
-    static constexpr uint8_t MAGIC[] = "LM002";
+    static constexpr uint8_t MAGIC[] = "LM004";
 
     enum class Format : uint8_t
     {
         Unknown = 0,
-        RGBF32 = 1,
+        RGBF32 = 1, //!< 3x float32
+        RGB16F = 2, //!< 3x float16
+        RGB9E5 = 3, //!< GL_UNSIGNED_INT_5_9_9_9_REV, 9-bit mantissas with a shared exponent
     };
 
     enum class Compression : uint8_t
     {
         None = 0,
+        LZ = 1, //!< Texture data is a single lz block (see lz_block.h), prefixed with its size
     };
+
+    //! Returns size of a luxel in bytes or 0 if format is invalid.
+    static constexpr size_t getLuxelSize(Format format) {
+        switch (format) {
+        case Format::RGBF32:
+            return 3 * sizeof(float);
+        case Format::RGB16F:
+            return 3 * sizeof(uint16_t);
+        case Format::RGB9E5:
+            return sizeof(uint32_t);
+        default:
+            return 0;
+        }
+    }
 };
 
 #endif
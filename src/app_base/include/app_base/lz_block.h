@@ -0,0 +1,35 @@
+#ifndef APP_BASE_LZ_BLOCK_H
+#define APP_BASE_LZ_BLOCK_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A small LZ77 block codec.
+ * The stream layout is compatible with the LZ4 block format: a sequence of
+ * (token, literals, match offset, match length) tuples with the last 5 bytes stored as literals.
+ * Only whole blocks are supported, there is no framing or checksum.
+ */
+namespace lz {
+
+/**
+ * Returns the maximum size of compressed data for an input of `size` bytes.
+ */
+size_t compressBound(size_t size);
+
+/**
+ * Compresses `size` bytes from `src`.
+ * @returns Compressed block
+ */
+std::vector<uint8_t> compress(const uint8_t *src, size_t size);
+
+/**
+ * Decompresses a block into `dst`.
+ * `dstSize` must exactly match the size of uncompressed data.
+ * Throws std::runtime_error if the block is malformed.
+ */
+void decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+
+} // namespace lz
+
+#endif
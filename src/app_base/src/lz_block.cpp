@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <app_base/lz_block.h>
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5;  //!< Last bytes are always literals
+constexpr size_t MF_LIMIT = 12;      //!< Last match must start this far from the end
+constexpr size_t MAX_OFFSET = 65535;
+constexpr int HASH_LOG = 16;
+constexpr size_t HASH_SIZE = (size_t)1 << HASH_LOG;
+constexpr uint32_t NO_POS = UINT32_MAX;
+
+inline uint32_t read32(const uint8_t *p) {
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+inline uint32_t hash32(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - HASH_LOG);
+}
+
+inline void writeLength(std::vector<uint8_t> &out, size_t len) {
+    while (len >= 255) {
+        out.push_back(255);
+        len -= 255;
+    }
+
+    out.push_back((uint8_t)len);
+}
+
+void writeSequence(std::vector<uint8_t> &out, const uint8_t *literals, size_t litLen,
+                   size_t offset, size_t matchLen) {
+    size_t ml = matchLen - MIN_MATCH;
+    uint8_t token = (uint8_t)((std::min<size_t>(litLen, 15) << 4) | std::min<size_t>(ml, 15));
+    out.push_back(token);
+
+    if (litLen >= 15) {
+        writeLength(out, litLen - 15);
+    }
+
+    out.insert(out.end(), literals, literals + litLen);
+    out.push_back((uint8_t)(offset & 0xFF));
+    out.push_back((uint8_t)(offset >> 8));
+
+    if (ml >= 15) {
+        writeLength(out, ml - 15);
+    }
+}
+
+void writeLastLiterals(std::vector<uint8_t> &out, const uint8_t *literals, size_t litLen) {
+    out.push_back((uint8_t)(std::min<size_t>(litLen, 15) << 4));
+
+    if (litLen >= 15) {
+        writeLength(out, litLen - 15);
+    }
+
+    out.insert(out.end(), literals, literals + litLen);
+}
+
+[[noreturn]] void throwMalformed() {
+    throw std::runtime_error("lz: malformed compressed block");
+}
+
+} // namespace
+
+size_t lz::compressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+std::vector<uint8_t> lz::compress(const uint8_t *src, size_t size) {
+    std::vector<uint8_t> out;
+    out.reserve(compressBound(size));
+    size_t anchor = 0;
+
+    if (size > MF_LIMIT) {
+        std::vector<uint32_t> table(HASH_SIZE, NO_POS);
+        size_t matchLimit = size - LAST_LITERALS;
+        size_t mfLimit = size - MF_LIMIT;
+        size_t pos = 0;
+
+        while (pos < mfLimit) {
+            uint32_t seq = read32(src + pos);
+            uint32_t h = hash32(seq);
+            size_t cand = table[h];
+            table[h] = (uint32_t)pos;
+
+            if (cand == NO_POS || pos - cand > MAX_OFFSET || read32(src + cand) != seq) {
+                pos++;
+                continue;
+            }
+
+            // Extend the match forwards and backwards
+            size_t len = MIN_MATCH;
+
+            while (pos + len < matchLimit && src[cand + len] == src[pos + len]) {
+                len++;
+            }
+
+            while (pos > anchor && cand > 0 && src[pos - 1] == src[cand - 1]) {
+                pos--;
+                cand--;
+                len++;
+            }
+
+            writeSequence(out, src + anchor, pos - anchor, pos - cand, len);
+            pos += len;
+            anchor = pos;
+        }
+    }
+
+    writeLastLiterals(out, src + anchor, size - anchor);
+    return out;
+}
+
+void lz::decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + srcSize;
+    size_t op = 0;
+
+    auto readLength = [&](size_t len) {
+        if (len == 15) {
+            uint8_t b;
+
+            do {
+                if (ip >= iend) {
+                    throwMalformed();
+                }
+
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+
+        return len;
+    };
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        // Literals
+        size_t litLen = readLength(token >> 4);
+
+        if (litLen > (size_t)(iend - ip) || litLen > dstSize - op) {
+            throwMalformed();
+        }
+
+        memcpy(dst + op, ip, litLen);
+        ip += litLen;
+        op += litLen;
+
+        if (ip == iend) {
+            // Last sequence has no match
+            break;
+        }
+
+        // Match
+        if (iend - ip < 2) {
+            throwMalformed();
+        }
+
+        size_t offset = ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        size_t matchLen = readLength(token & 0x0F) + MIN_MATCH;
+
+        if (offset == 0 || offset > op || matchLen > dstSize - op) {
+            throwMalformed();
+        }
+
+        // Copy byte by byte, the match may overlap the output
+        const uint8_t *match = dst + op - offset;
+
+        for (size_t i = 0; i < matchLen; i++) {
+            dst[op + i] = match[i];
+        }
+
+        op += matchLen;
+    }
+
+    if (op != dstSize) {
+        throwMalformed();
+    }
+}
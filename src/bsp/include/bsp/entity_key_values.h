@@ -1,5 +1,7 @@
 #ifndef BSP_ENTITY_KEY_VALUES_H
 #define BSP_ENTITY_KEY_VALUES_H
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
 #include <string_view>
@@ -8,26 +10,41 @@
 namespace bsp {
 
 //! A value of an entitiy's parameter.
+//! Numbers are parsed when the value is set, getters don't modify the value.
 class EntityValue {
 public:
     EntityValue() = default;
-    EntityValue(const std::string &value) { m_Value = value; }
+    EntityValue(const std::string &value) { setString(value); }
 
     const std::string &asString() const { return m_Value; }
-    const int asInt() const { return std::stoi(m_Value, nullptr, 10); }
-    const float asFloat() const { return std::stof(m_Value, nullptr); }
+    const int asInt() const;
+    const float asFloat() const;
     const glm::ivec3 asInt3() const;
     const glm::ivec4 asInt4() const;
     const glm::vec3 asFloat3() const;
     const glm::vec4 asFloat4() const; 
 
-    void setString(std::string_view str) { m_Value = str; }
+    void setString(std::string_view str);
 
 private:
+    struct Numbers {
+        glm::vec4 vFloats = glm::vec4(0, 0, 0, 0);
+        glm::ivec4 vInts = glm::ivec4(0, 0, 0, 0);
+        uint8_t uFloatCount = 0; //!< Number of successfully parsed floats
+        uint8_t uIntCount = 0;   //!< Number of successfully parsed ints
+    };
+
     std::string m_Value;
+    Numbers m_Numbers;
 };
 
+//! Interned key names shared by entities of a dict.
+class EntityKeyPool;
+
 //! Key-value pair of an entity's parameter.
+//! Key names are interned in a pool shared with other entities of the dict.
+//! Keys are looked up in a per-entity hash table of interned keys.
+//! Entities that share a pool must not add keys from multiple threads at the same time.
 class EntityKeyValues {
 public:
     //! @returns the index of a key or -1 if not found.
@@ -37,7 +54,7 @@ public:
     inline int size() const { return (int)m_Keys.size(); }
 
     //! @returns key name of key idx (must be valid).
-    inline const std::string &getKeyName(int idx) const { return m_Keys[idx].key; }
+    inline const std::string &getKeyName(int idx) const { return *m_Keys[idx].pKey; }
 
     //! @returns a value with specified key. If not found, throws std::invalid_argument.
     EntityValue &get(std::string_view key);
@@ -63,6 +80,9 @@ public:
     //! @returns index of the new key.
     int addNewKey(std::string_view name);
 
+    //! Reserves space for key-value pairs.
+    void reserve(int count);
+
     //! Sets key's value to a string.
     void setString(std::string_view key, std::string_view str);
 
@@ -74,14 +94,42 @@ public:
 
 private:
     struct KeyValue {
-        std::string key;
+        const std::string *pKey = nullptr; //!< Interned key name
         EntityValue value;
     };
 
+    struct KeyIndex {
+        const std::string *pKey = nullptr; //!< Interned key name or null if the slot is empty
+        int iIndex = -1;                   //!< Index in m_Keys
+    };
+
+    static constexpr size_t MIN_KEY_INDEX_SIZE = 8;
+
     int m_iTargetName = -1;
     int m_iClassName = -1;
 
+    std::shared_ptr<EntityKeyPool> m_pKeyPool;
     std::vector<KeyValue> m_Keys;
+
+    //! Open addressing hash table of the first occurrence of each key.
+    //! Size is zero or a power of two, at most half of the slots are used.
+    std::vector<KeyIndex> m_KeyIndex;
+    int m_iUniqueKeyCount = 0;
+
+    //! @returns hash of an interned key.
+    static size_t hashKey(const std::string *pKey);
+
+    //! @returns the index of the key's slot in m_KeyIndex or of an empty slot where it can
+    //! be inserted. m_KeyIndex must not be empty.
+    size_t findKeyIndexSlot(const std::string *pKey) const;
+
+    //! Rebuilds m_KeyIndex with specified size (a power of two).
+    void resizeKeyIndex(size_t size);
+
+    //! @returns value of key idx or an empty string.
+    const std::string &getStringOrEmpty(int idx) const;
+
+    friend class EntityKeyValuesDict;
 };
 
 //! A collection of entities and their parameters.
@@ -91,6 +139,7 @@ public:
     EntityKeyValuesDict(std::string_view entityLump);
 
     //! Loads entities from the entity lump string.
+    //! Key names of all entities are interned into one pool.
     //! On parse error, throws std::runtime_error.
     void loadFromString(std::string_view entityLump);
 
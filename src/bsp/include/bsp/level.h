@@ -10,6 +10,8 @@
 #include <appfw/appfw.h>
 #include <appfw/span.h>
 #include <bsp/bsp_types.h>
+#include <bsp/lump_view.h>
+#include <bsp/mapped_file.h>
 
 namespace bsp {
 
@@ -18,8 +20,14 @@ public:
     using std::runtime_error::runtime_error;
 };
 
-class Level {
+//! A BSP level.
+//! Lumps are not copied, they are accessed directly in the file that is mapped into memory.
+//! Only lumps that aren't aligned in the file and lumps that need conversion are copied.
+class Level : appfw::NoCopy {
 public:
+    //! Maximum memory used by decompressed PVS of all leaves.
+    static constexpr size_t PVS_CACHE_MAX_SIZE = 32 * 1024 * 1024;
+
     /**
      * Constructs an empty level.
      */
@@ -36,17 +44,26 @@ public:
     Level(const std::string &filename);
 
     /**
-     * Loads BSP from a .bsp file.
+     * Loads BSP from a .bsp file. The file is mapped into memory and stays open.
      */
     void loadFromFile(const fs::path &path);
 
     /**
-     * Loads BSP from supplied contents of .bsp.
+     * Loads BSP from supplied contents of .bsp. The data is copied.
      */
     void loadFromBytes(appfw::span<uint8_t> data);
 
-    //! Returns the vertices of a face.
-    std::vector<glm::vec3> getFaceVertices(const bsp::BSPFace &face) const;
+    //! Returns the vertices of a face. They are stored in a pool created when the level is loaded.
+    inline appfw::span<const glm::vec3> getFaceVertices(size_t faceIdx) const {
+        const glm::vec3 *pFirst = m_FaceVertices.data() + m_FaceVertexOffsets[faceIdx];
+        return {pFirst, m_FaceVertexOffsets[faceIdx + 1] - m_FaceVertexOffsets[faceIdx]};
+    }
+
+    //! Returns the vertices of a face. Face must be from getFaces().
+    inline appfw::span<const glm::vec3> getFaceVertices(const bsp::BSPFace &face) const {
+        AFW_ASSERT(&face >= m_Faces.begin() && &face < m_Faces.end());
+        return getFaceVertices((size_t)(&face - m_Faces.data()));
+    }
 
     /**
      * Traces a line and returns contents of hit leaf
@@ -61,46 +78,84 @@ public:
     int pointInLeaf(glm::vec3 p) const noexcept;
 
     /**
-     * Decompresses (RLE) PVS data for a leaf.
+     * Returns decompressed PVS data for a leaf. Bit N is set if leaf N + 1 is visible.
+     * PVS of all leaves is decompressed when the level is loaded if it fits into
+     * PVS_CACHE_MAX_SIZE. Otherwise it is decompressed into buf on each call.
      * @param   leaf    Negative leaf index
      * @param   buf     Buffer of size at least (bsp::MAX_MAP_LEAFS / 8) to decompress PVS into
-     * @return Poitner into buf or to a static buffer if not vis is loaded
+     * @return Pointer into the cache, into buf or to a static buffer if not vis is loaded.
+     *         At least getPVSRowSize() bytes are readable.
      */
     const uint8_t *leafPVS(int leaf, appfw::span<uint8_t> buf) const noexcept;
 
-    inline const std::vector<BSPPlane> &getPlanes() const { return m_Planes; }
+    //! Returns the size of a decompressed PVS row in bytes. Always a multiple of 8.
+    inline size_t getPVSRowSize() const { return m_uPVSRowWords * sizeof(uint64_t); }
+
+    //! Sets dst to (dst | src). Both must be at least getPVSRowSize() bytes.
+    void unionPVS(uint8_t *dst, const uint8_t *src) const noexcept;
+
+    //! Sets dst to (dst & src). Both must be at least getPVSRowSize() bytes.
+    void intersectPVS(uint8_t *dst, const uint8_t *src) const noexcept;
+
+    inline const LumpView<BSPPlane> &getPlanes() const { return m_Planes; }
     inline const std::vector<BSPMipTex> &getTextures() const { return m_Textures; }
-    inline const std::vector<glm::vec3> &getVertices() const { return m_Vertices; }
-    inline const std::vector<uint8_t> &getVisData() const { return m_VisData; }
-    inline const std::vector<BSPNode> &getNodes() const { return m_Nodes; }
-    inline const std::vector<BSPTextureInfo> &getTexInfo() const { return m_TexInfo; }
-    inline const std::vector<BSPFace> &getFaces() const { return m_Faces; }
-    inline const std::vector<uint8_t> &getLightMaps() const { return m_Lightmaps; }
-    inline const std::vector<BSPLeaf> &getLeaves() const { return m_Leaves; }
-    inline const std::vector<BSPMarkSurface> &getMarkSurfaces() const { return m_MarkSurfaces; }
-    inline const std::vector<BSPEdge> &getEdges() const { return m_Edges; }
-    inline const std::vector<BSPSurfEdge> &getSurfEdges() const { return m_SurfEdges; }
-    inline const std::vector<BSPModel> &getModels() const { return m_Models; }
+    inline const LumpView<glm::vec3> &getVertices() const { return m_Vertices; }
+    inline const LumpView<uint8_t> &getVisData() const { return m_VisData; }
+    inline const LumpView<BSPNode> &getNodes() const { return m_Nodes; }
+    inline const LumpView<BSPTextureInfo> &getTexInfo() const { return m_TexInfo; }
+    inline const LumpView<BSPFace> &getFaces() const { return m_Faces; }
+    inline const LumpView<uint8_t> &getLightMaps() const { return m_Lightmaps; }
+    inline const LumpView<BSPLeaf> &getLeaves() const { return m_Leaves; }
+    inline const LumpView<BSPMarkSurface> &getMarkSurfaces() const { return m_MarkSurfaces; }
+    inline const LumpView<BSPEdge> &getEdges() const { return m_Edges; }
+    inline const LumpView<BSPSurfEdge> &getSurfEdges() const { return m_SurfEdges; }
+    inline const LumpView<BSPModel> &getModels() const { return m_Models; }
     inline const std::string &getEntitiesLump() const { return m_Entities; }
-    inline const std::vector<uint8_t> &getRawTextures() const { return m_RawTextureLump; }
+    inline const LumpView<uint8_t> &getRawTextures() const { return m_RawTextureLump; }
 
 private:
-    std::vector<BSPPlane> m_Planes;
+    MappedFile m_File;                              //!< Mapped .bsp file
+    std::vector<uint8_t> m_FileCopy;                //!< Copy of data passed to loadFromBytes
+    std::vector<std::vector<uint8_t>> m_LumpCopies; //!< Copies of unaligned lumps
+
+    LumpView<BSPPlane> m_Planes;
     std::vector<BSPMipTex> m_Textures;
-    std::vector<glm::vec3> m_Vertices;
-    std::vector<uint8_t> m_VisData;
-    std::vector<BSPNode> m_Nodes;
-    std::vector<BSPTextureInfo> m_TexInfo;
-    std::vector<BSPFace> m_Faces;
-    std::vector<uint8_t> m_Lightmaps;
-    std::vector<BSPLeaf> m_Leaves;
-    std::vector<BSPMarkSurface> m_MarkSurfaces;
-    std::vector<BSPEdge> m_Edges;
-    std::vector<BSPSurfEdge> m_SurfEdges;
-    std::vector<BSPModel> m_Models;
-    std::vector<uint8_t> m_RawTextureLump;
+    LumpView<glm::vec3> m_Vertices;
+    LumpView<uint8_t> m_VisData;
+    LumpView<BSPNode> m_Nodes;
+    LumpView<BSPTextureInfo> m_TexInfo;
+    LumpView<BSPFace> m_Faces;
+    LumpView<uint8_t> m_Lightmaps;
+    LumpView<BSPLeaf> m_Leaves;
+    LumpView<BSPMarkSurface> m_MarkSurfaces;
+    LumpView<BSPEdge> m_Edges;
+    LumpView<BSPSurfEdge> m_SurfEdges;
+    LumpView<BSPModel> m_Models;
+    LumpView<uint8_t> m_RawTextureLump;
     std::string m_Entities;
 
+    std::vector<glm::vec3> m_FaceVertices;    //!< Vertices of all faces
+    std::vector<uint32_t> m_FaceVertexOffsets; //!< Offset into m_FaceVertices, count + 1 items
+
+    size_t m_uPVSRowWords = 0;        //!< Size of a PVS row in 64-bit words
+    std::vector<uint64_t> m_PVSCache; //!< Decompressed PVS of all leaves
+
+    //! Sets up lump views into the data.
+    //! Data must stay valid for the lifetime of the level.
+    void loadLumps(appfw::span<const uint8_t> data);
+
+    //! Builds the face vertex pool. Throws LevelFormatException if edges are invalid.
+    void buildFaceVertices();
+
+    //! Decompresses PVS of all leaves if it fits into the budget.
+    void buildPVSCache();
+
+    //! Decompresses (RLE) PVS row of a leaf.
+    //! @param  pLeaf   The leaf or nullptr if it has no vis data
+    //! @param  out     At least (leaf count + 7) / 8 bytes
+    //! @returns false if compressed data is out of bounds of the vis lump.
+    bool decompressPVS(const BSPLeaf *pLeaf, uint8_t *out) const noexcept;
+
     int recursiveTraceLine(int node, const glm::vec3 &from, const glm::vec3 &to) const;
 };
 
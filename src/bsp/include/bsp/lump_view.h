@@ -0,0 +1,45 @@
+#ifndef BSP_LUMP_VIEW_H
+#define BSP_LUMP_VIEW_H
+#include <cstddef>
+#include <stdexcept>
+
+namespace bsp {
+
+//! Read-only view of a lump array. Doesn't own the data, it belongs to the level.
+template <typename T>
+class LumpView {
+public:
+    using value_type = T;
+    using const_iterator = const T *;
+
+    LumpView() = default;
+    inline LumpView(const T *pData, size_t uSize)
+        : m_pData(pData)
+        , m_uSize(uSize) {}
+
+    inline const T *data() const { return m_pData; }
+    inline size_t size() const { return m_uSize; }
+    inline bool empty() const { return m_uSize == 0; }
+
+    inline const T *begin() const { return m_pData; }
+    inline const T *end() const { return m_pData + m_uSize; }
+
+    inline const T &operator[](size_t i) const { return m_pData[i]; }
+
+    //! Same as operator[] but throws std::out_of_range if index is invalid.
+    inline const T &at(size_t i) const {
+        if (i >= m_uSize) {
+            throw std::out_of_range("LumpView::at: index out of range");
+        }
+
+        return m_pData[i];
+    }
+
+private:
+    const T *m_pData = nullptr;
+    size_t m_uSize = 0;
+};
+
+} // namespace bsp
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef BSP_MAPPED_FILE_H
+#define BSP_MAPPED_FILE_H
+#include <cstddef>
+#include <cstdint>
+#include <appfw/utils.h>
+#include <appfw/span.h>
+
+namespace bsp {
+
+//! A file mapped into memory for reading.
+//! Pointers into the mapping stay valid until the file is closed, even if the object is moved.
+//! Can be read from any number of threads.
+class MappedFile : appfw::NoCopy {
+public:
+    MappedFile() = default;
+    MappedFile(MappedFile &&other) noexcept;
+    ~MappedFile();
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    //! Maps the file. Throws std::runtime_error on failure.
+    void open(const fs::path &path);
+
+    //! Unmaps the file.
+    void close();
+
+    //! @returns whether a file is mapped.
+    inline bool isOpen() const { return m_bIsOpen; }
+
+    //! @returns the contents of the file.
+    inline const uint8_t *data() const { return m_pData; }
+
+    //! @returns the size of the file.
+    inline size_t size() const { return m_uSize; }
+
+    //! @returns the contents of the file.
+    inline appfw::span<const uint8_t> getSpan() const { return { m_pData, m_uSize }; }
+
+private:
+    const uint8_t *m_pData = nullptr;
+    size_t m_uSize = 0;
+    bool m_bIsOpen = false;
+
+#ifdef _WIN32
+    void *m_hFile = nullptr;
+    void *m_hMapping = nullptr;
+#endif
+
+    void swap(MappedFile &other) noexcept;
+};
+
+} // namespace bsp
+
+#endif
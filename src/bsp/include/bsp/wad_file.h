@@ -1,10 +1,11 @@
 #ifndef BSP_WAD_FILE_H
 #define BSP_WAD_FILE_H
 #include <stdexcept>
-#include <mutex>
+#include <unordered_map>
 #include <appfw/utils.h>
 #include <appfw/span.h>
 #include <bsp/bsp_types.h>
+#include <bsp/mapped_file.h>
 
 namespace bsp {
 
@@ -37,29 +38,30 @@ public:
     //! @param   buffer  A buffer to put the image into
     void getRGBA(std::vector<uint8_t> &buffer) const;
 
+    //! Returns raw data of the lump. Points into the mapped file.
+    inline appfw::span<const uint8_t> getLumpData() const { return { m_pData, m_uFileSize }; }
+
 private:
-    WADFile *m_pFile = nullptr;
-    unsigned m_uFileOffset = 0;
+    const uint8_t *m_pData = nullptr;
     unsigned m_uFileSize = 0;
     BSPMipTex m_MipTex;
 
-    void init(WADFile *pFile, WADDirEntry &dirEntry);
-    std::vector<uint8_t> readColorTable() const;
-    std::vector<uint8_t> readIndexTable() const;
+    void init(const MappedFile &file, WADDirEntry &dirEntry);
+    const uint8_t *getColorTable() const;
+    const uint8_t *getIndexTable() const;
 
     friend class WADFile;
 };
 
-class WADFile {
+class WADFile : appfw::NoCopy {
 public:
     //! Maximum number of textures in a WAD file (some sane value, real maximum is INT32_MAX)
     static constexpr unsigned MAX_WAD_TEXTURES = 16384;
 
-    WADFile();
-
     //! Loads the list of textures from a .wad file.
-    //! The file will be kept open until it is closed.
-    //! No textures are loaded into memory until explicitly requested.
+    //! The file will be kept mapped into memory until it is closed.
+    //! No textures are decoded until explicitly requested. Textures can be decoded from
+    //! multiple threads.
     void loadFromFile(const fs::path &path);
 
     //! Closes the file.
@@ -68,12 +70,16 @@ public:
     //! List of textures from the WAD file.
     inline const std::vector<WADTexture> &getTextures() const { return m_Textures; }
 
+    //! Finds a texture by name. Case-insensitive.
+    //! @returns the texture or nullptr if not found.
+    const WADTexture *findTexture(std::string_view name) const;
+
 private:
-    std::mutex m_Mutex;
-    std::ifstream m_File;
+    MappedFile m_File;
     std::vector<WADTexture> m_Textures;
 
-    friend class WADTexture;
+    //! Lower-case name -> index in m_Textures
+    std::unordered_map<std::string, size_t> m_TextureIndex;
 };
 
 } // namespace bsp
@@ -1,59 +1,148 @@
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <deque>
+#include <unordered_map>
 #include <bsp/entity_key_values.h>
 
+//! Stores key names of entities. Keys are freed with the last entity that uses the pool.
+//! Not thread-safe.
+class bsp::EntityKeyPool {
+public:
+    //! @returns the interned key or nullptr if it's not in the pool.
+    const std::string *find(std::string_view key) const {
+        auto it = m_Keys.find(key);
+        return it != m_Keys.end() ? it->second : nullptr;
+    }
+
+    //! @returns the interned key. It is valid while the pool exists.
+    const std::string *intern(std::string_view key) {
+        auto it = m_Keys.find(key);
+
+        if (it != m_Keys.end()) {
+            return it->second;
+        }
+
+        const std::string *pKey = &m_Storage.emplace_back(key);
+        m_Keys.emplace(std::string_view(*pKey), pKey);
+        return pKey;
+    }
+
+private:
+    std::deque<std::string> m_Storage; //!< Doesn't move strings when grown
+    std::unordered_map<std::string_view, const std::string *> m_Keys;
+};
+
+namespace {
+
+inline bool isWhitespace(char c) {
+    return c == ' ' || c == '\r' || c == '\n' || c == '\t';
+}
+
+} // namespace
+
 //-----------------------------------------------------------------
 // EntityValue
 //-----------------------------------------------------------------
-const glm::ivec3 bsp::EntityValue::asInt3() const {
-    glm::ivec3 vec(0, 0, 0);
+const int bsp::EntityValue::asInt() const {
+    if (m_Numbers.uIntCount < 1) {
+        throw std::invalid_argument("value is not int");
+    }
+
+    return m_Numbers.vInts.x;
+}
 
-    if (sscanf(m_Value.c_str(), "%d %d %d", &vec.x, &vec.y, &vec.z) != 3) {
+const float bsp::EntityValue::asFloat() const {
+    if (m_Numbers.uFloatCount < 1) {
+        throw std::invalid_argument("value is not float");
+    }
+
+    return m_Numbers.vFloats.x;
+}
+
+const glm::ivec3 bsp::EntityValue::asInt3() const {
+    if (m_Numbers.uIntCount < 3) {
         throw std::invalid_argument("value is not ivec3");
     }
 
-    return vec;
+    return glm::ivec3(m_Numbers.vInts);
 }
 
 const glm::ivec4 bsp::EntityValue::asInt4() const {
-    glm::ivec4 vec(0, 0, 0, 0);
-
-    if (sscanf(m_Value.c_str(), "%d %d %d %d", &vec.x, &vec.y, &vec.z, &vec.w) != 4) {
+    if (m_Numbers.uIntCount < 4) {
         throw std::invalid_argument("value is not ivec4");
     }
 
-    return vec;
+    return m_Numbers.vInts;
 }
 
 const glm::vec3 bsp::EntityValue::asFloat3() const {
-    glm::vec3 vec(0, 0, 0);
-
-    if (sscanf(m_Value.c_str(), "%f %f %f", &vec.x, &vec.y, &vec.z) != 3) {
+    if (m_Numbers.uFloatCount < 3) {
         throw std::invalid_argument("value is not vec3");
     }
 
-    return vec;
+    return glm::vec3(m_Numbers.vFloats);
 }
 
 const glm::vec4 bsp::EntityValue::asFloat4() const {
-    glm::vec4 vec(0, 0, 0, 0);
-
-    if (sscanf(m_Value.c_str(), "%f %f %f %f", &vec.x, &vec.y, &vec.z, &vec.w) != 4) {
+    if (m_Numbers.uFloatCount < 4) {
         throw std::invalid_argument("value is not vec4");
     }
 
-    return vec;
+    return m_Numbers.vFloats;
+}
+
+void bsp::EntityValue::setString(std::string_view str) {
+    m_Value = str;
+
+    // Same rules as sscanf("%f %f %f %f") and sscanf("%d %d %d %d")
+    Numbers &numbers = m_Numbers;
+    numbers = Numbers();
+    const char *p = m_Value.c_str();
+
+    for (int i = 0; i < 4; i++) {
+        char *end = nullptr;
+        float val = std::strtof(p, &end);
+
+        if (end == p) {
+            break;
+        }
+
+        numbers.vFloats[i] = val;
+        numbers.uFloatCount++;
+        p = end;
+    }
+
+    p = m_Value.c_str();
+
+    for (int i = 0; i < 4; i++) {
+        char *end = nullptr;
+        errno = 0;
+        long val = std::strtol(p, &end, 10);
+
+        if (end == p || errno == ERANGE || val < INT_MIN || val > INT_MAX) {
+            break;
+        }
+
+        numbers.vInts[i] = (int)val;
+        numbers.uIntCount++;
+        p = end;
+    }
 }
 
 //-----------------------------------------------------------------
 // EntityKeyValues
 //-----------------------------------------------------------------
 int bsp::EntityKeyValues::indexOf(std::string_view key) const {
-    for (int i = 0; i < m_Keys.size(); i++) {
-        if (m_Keys[i].key == key) {
-            return i;
-        }
+    const std::string *pKey = m_pKeyPool ? m_pKeyPool->find(key) : nullptr;
+
+    if (!pKey || m_KeyIndex.empty()) {
+        // No entity of the pool has the key
+        return -1;
     }
-    
-    return -1;
+
+    return m_KeyIndex[findKeyIndexSlot(pKey)].iIndex;
 }
 
 bsp::EntityValue &bsp::EntityKeyValues::get(std::string_view key) {
@@ -65,7 +154,7 @@ const bsp::EntityValue &bsp::EntityKeyValues::get(std::string_view key) const {
 }
 
 bsp::EntityValue &bsp::EntityKeyValues::get(int keyIdx) {
-    if (keyIdx < 0 || keyIdx > m_Keys.size()) {
+    if (keyIdx < 0 || keyIdx >= (int)m_Keys.size()) {
         throw std::invalid_argument("keyIdx is invalid");
     }
 
@@ -73,7 +162,7 @@ bsp::EntityValue &bsp::EntityKeyValues::get(int keyIdx) {
 }
 
 const bsp::EntityValue &bsp::EntityKeyValues::get(int keyIdx) const {
-    if (keyIdx < 0 || keyIdx > m_Keys.size()) {
+    if (keyIdx < 0 || keyIdx >= (int)m_Keys.size()) {
         throw std::invalid_argument("keyIdx is invalid");
     }
 
@@ -81,17 +170,34 @@ const bsp::EntityValue &bsp::EntityKeyValues::get(int keyIdx) const {
 }
 
 std::string bsp::EntityKeyValues::getClassName() const {
-    return m_iClassName != -1 ? m_Keys[m_iClassName].value.asString() : "";
+    return getStringOrEmpty(m_iClassName);
 }
 
 std::string bsp::EntityKeyValues::getTargetName() const {
-    return m_iTargetName != -1 ? m_Keys[m_iTargetName].value.asString() : "";
+    return getStringOrEmpty(m_iTargetName);
 }
 
 int bsp::EntityKeyValues::addNewKey(std::string_view name) {
+    if (!m_pKeyPool) {
+        m_pKeyPool = std::make_shared<EntityKeyPool>();
+    }
+
     int idx = size();
+    const std::string *pKey = m_pKeyPool->intern(name);
     m_Keys.emplace_back();
-    m_Keys[idx].key = name;
+    m_Keys[idx].pKey = pKey;
+
+    // Index the first occurrence of the key
+    if ((size_t)(m_iUniqueKeyCount + 1) * 2 > m_KeyIndex.size()) {
+        resizeKeyIndex(std::max(m_KeyIndex.size() * 2, MIN_KEY_INDEX_SIZE));
+    }
+
+    KeyIndex &slot = m_KeyIndex[findKeyIndexSlot(pKey)];
+
+    if (!slot.pKey) {
+        slot = {pKey, idx};
+        m_iUniqueKeyCount++;
+    }
 
     if (name == "targetname") {
         m_iTargetName = idx;
@@ -112,6 +218,53 @@ void bsp::EntityKeyValues::setString(std::string_view key, std::string_view str)
     get(idx).setString(str);
 }
 
+void bsp::EntityKeyValues::reserve(int count) {
+    m_Keys.reserve(count);
+    size_t indexSize = MIN_KEY_INDEX_SIZE;
+
+    while (indexSize < (size_t)count * 2) {
+        indexSize *= 2;
+    }
+
+    if (indexSize > m_KeyIndex.size()) {
+        resizeKeyIndex(indexSize);
+    }
+}
+
+size_t bsp::EntityKeyValues::hashKey(const std::string *pKey) {
+    // Interned keys are aligned, low bits of the address are always the same
+    uintptr_t val = reinterpret_cast<uintptr_t>(pKey) >> 3;
+    return (size_t)(val ^ (val >> 7) ^ (val >> 17));
+}
+
+size_t bsp::EntityKeyValues::findKeyIndexSlot(const std::string *pKey) const {
+    size_t mask = m_KeyIndex.size() - 1;
+    size_t i = hashKey(pKey) & mask;
+
+    // Table is never full, an empty slot is always found
+    while (m_KeyIndex[i].pKey && m_KeyIndex[i].pKey != pKey) {
+        i = (i + 1) & mask;
+    }
+
+    return i;
+}
+
+void bsp::EntityKeyValues::resizeKeyIndex(size_t size) {
+    std::vector<KeyIndex> oldIndex(size);
+    oldIndex.swap(m_KeyIndex);
+
+    for (const KeyIndex &item : oldIndex) {
+        if (item.pKey) {
+            m_KeyIndex[findKeyIndexSlot(item.pKey)] = item;
+        }
+    }
+}
+
+const std::string &bsp::EntityKeyValues::getStringOrEmpty(int idx) const {
+    static const std::string empty;
+    return idx != -1 ? m_Keys[idx].value.asString() : empty;
+}
+
 //-----------------------------------------------------------------
 // EntityKeyValuesDict
 //-----------------------------------------------------------------
@@ -121,16 +274,22 @@ bsp::EntityKeyValuesDict::EntityKeyValuesDict(std::string_view entityLump) {
 
 void bsp::EntityKeyValuesDict::loadFromString(std::string_view entityLump) {
     m_Ents.clear();
+    m_Ents.reserve(std::count(entityLump.begin(), entityLump.end(), '{'));
+    auto pKeyPool = std::make_shared<EntityKeyPool>();
     size_t i = 0;
 
     auto fnSkipWhitespace = [&]() {
-        auto &c = entityLump;
-        while (i < entityLump.size() && (c[i] == ' ' || c[i] == '\r' || c[i] == '\n' ||
-               c[i] == '\t')) {
+        while (i < entityLump.size() && isWhitespace(entityLump[i])) {
             i++;
         }
     };
 
+    // Moves i to the closing quote or to the end
+    auto fnFindQuote = [&]() {
+        size_t pos = entityLump.find('"', i);
+        i = pos != std::string_view::npos ? pos : entityLump.size();
+    };
+
     auto fnCheckEOF = [&]() {
         if (i >= entityLump.size()) {
             throw std::runtime_error("unexpected end of file at position " + std::to_string(i));
@@ -150,7 +309,9 @@ void bsp::EntityKeyValuesDict::loadFromString(std::string_view entityLump) {
         }
         i++;
 
-        EntityKeyValues item;
+        EntityKeyValues &item = m_Ents.emplace_back();
+        item.m_pKeyPool = pKeyPool;
+        item.reserve(8);
 
         while (i < entityLump.size()) {
             fnSkipWhitespace();
@@ -167,11 +328,7 @@ void bsp::EntityKeyValuesDict::loadFromString(std::string_view entityLump) {
 
             i++;
             size_t keyBegin = i;
-
-            while (entityLump[i] != '"' && i < entityLump.size()) {
-                i++;
-            }
-
+            fnFindQuote();
             fnCheckEOF();
             size_t keyEnd = i;
             i++;
@@ -184,11 +341,7 @@ void bsp::EntityKeyValuesDict::loadFromString(std::string_view entityLump) {
 
             i++;
             size_t valueBegin = i;
-
-            while (entityLump[i] != '"' && i < entityLump.size()) {
-                i++;
-            }
-
+            fnFindQuote();
             fnCheckEOF();
             size_t valueEnd = i;
             i++;
@@ -206,9 +359,6 @@ void bsp::EntityKeyValuesDict::loadFromString(std::string_view entityLump) {
             throw std::runtime_error("expected '}' at position " + std::to_string(i));
         }
         i++;
-
-        // Add item into the list
-        m_Ents.push_back(std::move(item));
     }
 }
 
@@ -220,7 +370,7 @@ std::string bsp::EntityKeyValuesDict::exportToString() const {
         ent += "{\n";
 
         for (int i = 0; i < kv.size(); i++) {
-            ent += fmt::format("\"{}\" \"{}\"\n");
+            ent += fmt::format("\"{}\" \"{}\"\n", kv.getKeyName(i), kv.get(i).asString());
         }
 
         ent += "}\n";
@@ -232,7 +382,7 @@ std::string bsp::EntityKeyValuesDict::exportToString() const {
 
 int bsp::EntityKeyValuesDict::findEntityByName(std::string_view targetName, int after) const {
     for (int i = after + 1; i < size(); i++) {
-        if (m_Ents[i].getTargetName() == targetName) {
+        if (m_Ents[i].getStringOrEmpty(m_Ents[i].m_iTargetName) == targetName) {
             return i;
         }
     }
@@ -242,7 +392,7 @@ int bsp::EntityKeyValuesDict::findEntityByName(std::string_view targetName, int
 
 int bsp::EntityKeyValuesDict::findEntityByClassName(std::string_view className, int after) const {
     for (int i = after + 1; i < size(); i++) {
-        if (m_Ents[i].getClassName() == className) {
+        if (m_Ents[i].getStringOrEmpty(m_Ents[i].m_iClassName) == className) {
             return i;
         }
     }
@@ -1,4 +1,4 @@
-#include <fstream>
+#include <algorithm>
 #include <vector>
 #include <appfw/appfw.h>
 #include <bsp/level.h>
@@ -24,17 +24,21 @@ bsp::Level::Level(appfw::span<uint8_t> data) { loadFromBytes(data); }
 bsp::Level::Level(const std::string &filename) { loadFromFile(filename); }
 
 void bsp::Level::loadFromFile(const fs::path &filename) {
-    std::ifstream file(filename, std::ios::in | std::ios::binary);
-    if (file.fail()) {
-        throw std::runtime_error(std::string("Failed to open file: ") + strerror(errno));
-    }
-
-    std::vector<uint8_t> data;
-    appfw::readFileContents(file, data);
-    loadFromBytes(data);
+    m_FileCopy.clear();
+    m_FileCopy.shrink_to_fit();
+    m_File.open(filename);
+    loadLumps(m_File.getSpan());
 }
 
 void bsp::Level::loadFromBytes(appfw::span<uint8_t> data) {
+    m_File.close();
+    m_FileCopy.assign(data.begin(), data.end());
+    loadLumps(m_FileCopy);
+}
+
+void bsp::Level::loadLumps(appfw::span<const uint8_t> data) {
+    m_LumpCopies.clear();
+
     if (data.empty()) {
         throw LevelFormatException("File is empty");
     }
@@ -52,35 +56,41 @@ void bsp::Level::loadFromBytes(appfw::span<uint8_t> data) {
         throw LevelFormatException(fmt::format("Version is invalid. Expected {}, got {}", HL_BSP_VERSION, bspHeader.nVersion));
     }
 
-    // Load lumps
-    auto fnLoadLump = [&](int lumpId, auto &storage) {
-        using Container = typename std::remove_reference<decltype(storage)>::type;
-        using DataType = typename Container::value_type;
+    auto fnGetLumpData = [&](int lumpId) {
         const BSPLump &lumpInfo = bspHeader.lump[lumpId];
 
-        if (lumpInfo.nOffset + lumpInfo.nLength > (int32_t)data.size()) {
+        if (lumpInfo.nOffset < 0 || lumpInfo.nLength < 0 ||
+            (size_t)lumpInfo.nOffset + (size_t)lumpInfo.nLength > data.size()) {
             throw LevelFormatException(fmt::format("{}: invalid size/offset", bsp::LUMP_NAME[lumpId]));
         }
 
-        appfw::span<uint8_t> lumpData = data.subspan(lumpInfo.nOffset, lumpInfo.nLength);
+        return data.subspan(lumpInfo.nOffset, lumpInfo.nLength);
+    };
+
+    // Load lumps
+    auto fnLoadLump = [&](int lumpId, auto &view) {
+        using View = typename std::remove_reference<decltype(view)>::type;
+        using DataType = typename View::value_type;
+        appfw::span<const uint8_t> lumpData = fnGetLumpData(lumpId);
 
         if (lumpData.size() % sizeof(DataType) != 0) {
             throw LevelFormatException(fmt::format("{}: incorrect size", bsp::LUMP_NAME[lumpId]));
         }
 
         size_t count = lumpData.size() / sizeof(DataType);
-        storage.resize(count);
-        memcpy(storage.data(), lumpData.data(), lumpData.size());
-    };
-
-    auto fnLoadTextures = [&]() {
-        const BSPLump &lumpInfo = bspHeader.lump[LUMP_TEXTURES];
+        const uint8_t *pLumpData = lumpData.data();
 
-        if (lumpInfo.nOffset + lumpInfo.nLength > (int32_t)data.size()) {
-            throw LevelFormatException(fmt::format("LUMP_TEXTURES: invalid size/offset."));
+        if ((uintptr_t)pLumpData % alignof(DataType) != 0) {
+            // Lump is not aligned in the file, it can't be accessed in-place
+            std::vector<uint8_t> &copy = m_LumpCopies.emplace_back(lumpData.begin(), lumpData.end());
+            pLumpData = copy.data();
         }
 
-        appfw::span<uint8_t> lumpData = data.subspan(lumpInfo.nOffset, lumpInfo.nLength);
+        view = View(reinterpret_cast<const DataType *>(pLumpData), count);
+    };
+
+    auto fnLoadTextures = [&]() {
+        appfw::span<const uint8_t> lumpData = fnGetLumpData(LUMP_TEXTURES);
 
         // Copy header
         BSPTextureHeader header;
@@ -136,37 +146,59 @@ void bsp::Level::loadFromBytes(appfw::span<uint8_t> data) {
     }
 
     // Load entities
-    std::vector<char> entLump;
-    fnLoadLump(LUMP_ENTITIES, entLump);
+    appfw::span<const uint8_t> entLump = fnGetLumpData(LUMP_ENTITIES);
+    const char *pEntData = reinterpret_cast<const char *>(entLump.data());
 
-    if (entLump[entLump.size() - 1] == '\0') {
-        m_Entities = std::string(entLump.data(), entLump.size() - 1);
+    if (!entLump.empty() && entLump[entLump.size() - 1] == '\0') {
+        m_Entities = std::string(pEntData, entLump.size() - 1);
     } else {
-        m_Entities = std::string(entLump.data(), entLump.size());
+        m_Entities = std::string(pEntData, entLump.size());
     }
+
+    buildFaceVertices();
+    buildPVSCache();
 }
 
-std::vector<glm::vec3> bsp::Level::getFaceVertices(const bsp::BSPFace &face) const {
-    std::vector<glm::vec3> verts;
-    auto &lvlVertices = getVertices();
-    auto &lvlSurfEdges = getSurfEdges();
+void bsp::Level::buildFaceVertices() {
+    size_t totalCount = 0;
+
+    for (const BSPFace &face : m_Faces) {
+        totalCount += std::max<int>(face.nEdges, 0);
+    }
 
-    for (int j = 0; j < face.nEdges; j++) {
-        glm::vec3 vertex;
-        bsp::BSPSurfEdge iEdgeIdx = lvlSurfEdges[(size_t)face.iFirstEdge + j];
+    m_FaceVertices.clear();
+    m_FaceVertices.reserve(totalCount);
+    m_FaceVertexOffsets.resize(m_Faces.size() + 1);
 
-        if (iEdgeIdx > 0) {
-            const bsp::BSPEdge &edge = getEdges()[iEdgeIdx];
-            vertex = lvlVertices[edge.iVertex[0]];
-        } else {
-            const bsp::BSPEdge &edge = getEdges()[-iEdgeIdx];
-            vertex = lvlVertices[edge.iVertex[1]];
+    for (size_t i = 0; i < m_Faces.size(); i++) {
+        const BSPFace &face = m_Faces[i];
+        m_FaceVertexOffsets[i] = (uint32_t)m_FaceVertices.size();
+
+        if (face.iFirstEdge < 0 ||
+            (size_t)face.iFirstEdge + std::max<int>(face.nEdges, 0) > m_SurfEdges.size()) {
+            throw LevelFormatException(fmt::format("Face {}: invalid edges", i));
         }
 
-        verts.push_back(vertex);
+        for (int j = 0; j < face.nEdges; j++) {
+            BSPSurfEdge iEdgeIdx = m_SurfEdges[(size_t)face.iFirstEdge + j];
+            size_t edgeIdx = iEdgeIdx > 0 ? (size_t)iEdgeIdx : (size_t)(-(int64_t)iEdgeIdx);
+
+            if (edgeIdx >= m_Edges.size()) {
+                throw LevelFormatException(fmt::format("Face {}: invalid edge {}", i, iEdgeIdx));
+            }
+
+            const BSPEdge &edge = m_Edges[edgeIdx];
+            size_t vertIdx = iEdgeIdx > 0 ? edge.iVertex[0] : edge.iVertex[1];
+
+            if (vertIdx >= m_Vertices.size()) {
+                throw LevelFormatException(fmt::format("Face {}: invalid vertex {}", i, vertIdx));
+            }
+
+            m_FaceVertices.push_back(m_Vertices[vertIdx]);
+        }
     }
 
-    return verts;
+    m_FaceVertexOffsets[m_Faces.size()] = (uint32_t)m_FaceVertices.size();
 }
 
 int bsp::Level::traceLine(glm::vec3 from, glm::vec3 to) const {
@@ -198,51 +230,107 @@ const uint8_t *bsp::Level::leafPVS(int leaf, appfw::span<uint8_t> buf) const noe
     AFW_ASSERT(buf.size() >= bsp::MAX_MAP_LEAFS / 8);
     int leafIdx = ~leaf;
 
+    if (!m_PVSCache.empty()) {
+        return reinterpret_cast<const uint8_t *>(m_PVSCache.data() + leafIdx * m_uPVSRowWords);
+    }
+
     if (leafIdx == 0) {
         return s_NoVis.data;
     }
 
-    const bsp::BSPLeaf *pLeaf = (leaf != 0) ? &m_Leaves[leafIdx] : nullptr;
+    AFW_ASSERT(buf.size() >= getPVSRowSize());
+    memset(buf.data(), 0, getPVSRowSize());
+
+    if (!decompressPVS(&m_Leaves[leafIdx], buf.data())) {
+        // Invalid vis data, make all visible
+        decompressPVS(nullptr, buf.data());
+    }
+
+    return buf.data();
+}
 
-    // Decompress VIS
-    int row = ((int)m_Leaves.size() + 7) >> 3;
-    const uint8_t *in = nullptr;
-    uint8_t *out = buf.data();
+void bsp::Level::unionPVS(uint8_t *dst, const uint8_t *src) const noexcept {
+    for (size_t i = 0; i < m_uPVSRowWords; i++) {
+        uint64_t a, b;
+        memcpy(&a, dst + i * sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(&b, src + i * sizeof(uint64_t), sizeof(uint64_t));
+        a |= b;
+        memcpy(dst + i * sizeof(uint64_t), &a, sizeof(uint64_t));
+    }
+}
 
-    glm::vec3 v;
-    v[0] = 1;
+void bsp::Level::intersectPVS(uint8_t *dst, const uint8_t *src) const noexcept {
+    for (size_t i = 0; i < m_uPVSRowWords; i++) {
+        uint64_t a, b;
+        memcpy(&a, dst + i * sizeof(uint64_t), sizeof(uint64_t));
+        memcpy(&b, src + i * sizeof(uint64_t), sizeof(uint64_t));
+        a &= b;
+        memcpy(dst + i * sizeof(uint64_t), &a, sizeof(uint64_t));
+    }
+}
 
-    if (!pLeaf || pLeaf->nVisOffset == -1) {
-        in = nullptr;
-    } else {
-        in = m_VisData.data() + pLeaf->nVisOffset;
+void bsp::Level::buildPVSCache() {
+    size_t leafCount = m_Leaves.size();
+    m_uPVSRowWords = (leafCount + 63) / 64;
+    m_PVSCache.clear();
+    m_PVSCache.shrink_to_fit();
+
+    size_t cacheSize = leafCount * m_uPVSRowWords * sizeof(uint64_t);
+
+    if (leafCount == 0 || cacheSize > PVS_CACHE_MAX_SIZE) {
+        // Will be decompressed on demand
+        return;
     }
 
-    if (!in) {
-        // No vis info, so make all visible
-        while (row) {
-            *out++ = 0xff;
-            row--;
+    m_PVSCache.resize(leafCount * m_uPVSRowWords);
+
+    for (size_t i = 0; i < leafCount; i++) {
+        uint8_t *row = reinterpret_cast<uint8_t *>(m_PVSCache.data() + i * m_uPVSRowWords);
+
+        if (i == 0 || !decompressPVS(&m_Leaves[i], row)) {
+            decompressPVS(nullptr, row);
         }
-        return buf.data();
+    }
+}
+
+bool bsp::Level::decompressPVS(const BSPLeaf *pLeaf, uint8_t *out) const noexcept {
+    size_t row = (m_Leaves.size() + 7) >> 3;
+
+    if (!pLeaf || pLeaf->nVisOffset == -1 || m_VisData.empty()) {
+        // No vis info, so make all visible
+        memset(out, 0xFF, row);
+        return true;
     }
 
-    do {
+    if (pLeaf->nVisOffset < 0 || (size_t)pLeaf->nVisOffset >= m_VisData.size()) {
+        return false;
+    }
+
+    const uint8_t *in = m_VisData.data() + pLeaf->nVisOffset;
+    const uint8_t *inEnd = m_VisData.data() + m_VisData.size();
+    size_t outPos = 0;
+
+    while (outPos < row) {
+        if (in >= inEnd) {
+            return false;
+        }
+
         if (*in) {
-            *out++ = *in++;
+            out[outPos++] = *in++;
             continue;
         }
 
-        int c = in[1];
-        in += 2;
-
-        while (c) {
-            *out++ = 0;
-            c--;
+        if (in + 1 >= inEnd) {
+            return false;
         }
-    } while (out - buf.data() < row);
 
-    return buf.data();
+        size_t c = std::min<size_t>(in[1], row - outPos);
+        in += 2;
+        memset(out + outPos, 0, c);
+        outPos += c;
+    }
+
+    return true;
 }
 
 int bsp::Level::recursiveTraceLine(int nodeidx, const glm::vec3 &start, const glm::vec3 &stop) const {
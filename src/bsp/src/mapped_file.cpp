@@ -0,0 +1,173 @@
+#include <fmt/format.h>
+#include <appfw/appfw.h>
+#include <bsp/mapped_file.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bsp::MappedFile::MappedFile(MappedFile &&other) noexcept {
+    swap(other);
+}
+
+bsp::MappedFile::~MappedFile() {
+    close();
+}
+
+bsp::MappedFile &bsp::MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+        swap(other);
+    }
+
+    return *this;
+}
+
+#ifdef _WIN32
+
+void bsp::MappedFile::open(const fs::path &path) {
+    close();
+
+    HANDLE hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error(
+            fmt::format("failed to open '{}': error {}", path.u8string(), GetLastError()));
+    }
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(hFile, &fileSize)) {
+        DWORD error = GetLastError();
+        CloseHandle(hFile);
+        throw std::runtime_error(
+            fmt::format("failed to get size of '{}': error {}", path.u8string(), error));
+    }
+
+    m_hFile = hFile;
+    m_uSize = (size_t)fileSize.QuadPart;
+    m_bIsOpen = true;
+
+    if (m_uSize == 0) {
+        // Empty files can't be mapped
+        return;
+    }
+
+    m_hMapping = CreateFileMappingW(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (!m_hMapping) {
+        DWORD error = GetLastError();
+        close();
+        throw std::runtime_error(
+            fmt::format("failed to map '{}': error {}", path.u8string(), error));
+    }
+
+    m_pData = static_cast<const uint8_t *>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+
+    if (!m_pData) {
+        DWORD error = GetLastError();
+        close();
+        throw std::runtime_error(
+            fmt::format("failed to map '{}': error {}", path.u8string(), error));
+    }
+}
+
+void bsp::MappedFile::close() {
+    if (m_pData) {
+        UnmapViewOfFile(m_pData);
+    }
+
+    if (m_hMapping) {
+        CloseHandle(m_hMapping);
+    }
+
+    if (m_hFile) {
+        CloseHandle(m_hFile);
+    }
+
+    m_pData = nullptr;
+    m_uSize = 0;
+    m_bIsOpen = false;
+    m_hFile = nullptr;
+    m_hMapping = nullptr;
+}
+
+void bsp::MappedFile::swap(MappedFile &other) noexcept {
+    std::swap(m_pData, other.m_pData);
+    std::swap(m_uSize, other.m_uSize);
+    std::swap(m_bIsOpen, other.m_bIsOpen);
+    std::swap(m_hFile, other.m_hFile);
+    std::swap(m_hMapping, other.m_hMapping);
+}
+
+#else
+
+void bsp::MappedFile::open(const fs::path &path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+
+    if (fd == -1) {
+        throw std::runtime_error(
+            fmt::format("failed to open '{}': {}", path.u8string(), strerror(errno)));
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) == -1) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error(
+            fmt::format("failed to get size of '{}': {}", path.u8string(), strerror(error)));
+    }
+
+    m_uSize = (size_t)st.st_size;
+    m_bIsOpen = true;
+
+    if (m_uSize == 0) {
+        // Empty files can't be mapped
+        ::close(fd);
+        return;
+    }
+
+    void *pData = mmap(nullptr, m_uSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+
+    // The mapping keeps a reference to the file
+    ::close(fd);
+
+    if (pData == MAP_FAILED) {
+        m_uSize = 0;
+        m_bIsOpen = false;
+        throw std::runtime_error(
+            fmt::format("failed to map '{}': {}", path.u8string(), strerror(error)));
+    }
+
+    m_pData = static_cast<const uint8_t *>(pData);
+}
+
+void bsp::MappedFile::close() {
+    if (m_pData) {
+        munmap(const_cast<uint8_t *>(m_pData), m_uSize);
+    }
+
+    m_pData = nullptr;
+    m_uSize = 0;
+    m_bIsOpen = false;
+}
+
+void bsp::MappedFile::swap(MappedFile &other) noexcept {
+    std::swap(m_pData, other.m_pData);
+    std::swap(m_uSize, other.m_uSize);
+    std::swap(m_bIsOpen, other.m_bIsOpen);
+}
+
+#endif
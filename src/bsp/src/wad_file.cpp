@@ -1,132 +1,155 @@
-#include <fstream>
 #include <fmt/format.h>
 #include <appfw/appfw.h>
+#include <appfw/str_utils.h>
 #include <bsp/wad_file.h>
 
+namespace {
+
+//! Builds RGBA lookup table for a color table.
+//! @param  transparent Whether index 255 is transparent
+void buildPalette(const uint8_t *colorTable, bool transparent, uint32_t palette[256]) {
+    for (int i = 0; i < 256; i++) {
+        const uint8_t *color = colorTable + 3 * i;
+        uint8_t rgba[4] = {color[0], color[1], color[2], 255};
+        memcpy(&palette[i], rgba, sizeof(rgba));
+    }
+
+    if (transparent) {
+        palette[255] = 0;
+    }
+}
+
+} // namespace
+
 void bsp::WADTexture::getRGB(std::vector<uint8_t> &buffer) const {
-    std::lock_guard lock(m_pFile->m_Mutex);
-    std::vector<uint8_t> colorTable = readColorTable();
-    std::vector<uint8_t> indexTable = readIndexTable();
-    buffer.resize((size_t)3 * getWide() * getTall());
-
-    for (unsigned i = 0; i < indexTable.size(); i++) {
-        uint8_t index = indexTable[i];
-        uint8_t *color = &colorTable[3 * index];
-        memcpy(&buffer[3 * i], color, 3);
+    const uint8_t *indexTable = getIndexTable();
+    uint32_t palette[256];
+    buildPalette(getColorTable(), false, palette);
+
+    size_t pixelCount = (size_t)getWide() * getTall();
+    buffer.resize(3 * pixelCount + 1); // +1 so that last pixel can be written as 4 bytes
+    uint8_t *out = buffer.data();
+
+    for (size_t i = 0; i < pixelCount; i++) {
+        // Write 4 bytes, the extra one is overwritten by the next pixel
+        memcpy(out + 3 * i, &palette[indexTable[i]], 4);
     }
+
+    buffer.resize(3 * pixelCount);
 }
 
 void bsp::WADTexture::getRGBA(std::vector<uint8_t> &buffer) const {
-    std::lock_guard lock(m_pFile->m_Mutex);
-    std::vector<uint8_t> colorTable = readColorTable();
-    std::vector<uint8_t> indexTable = readIndexTable();
-    buffer.resize((size_t)4 * getWide() * getTall());
-
-    for (unsigned i = 0; i < indexTable.size(); i++) {
-        uint8_t index = indexTable[i];
-
-        if (index != 255) {
-            // Solid pixel
-            uint8_t *color = &colorTable[3 * index];
-            memcpy(&buffer[4 * i], color, 3);
-            buffer[4 * i + 3] = 255;
-        } else {
-            // Transparent pixel
-            memset(&buffer[4 * i], 0, 4);
-        }
+    const uint8_t *indexTable = getIndexTable();
+    uint32_t palette[256];
+    buildPalette(getColorTable(), true, palette);
+
+    size_t pixelCount = (size_t)getWide() * getTall();
+    buffer.resize(4 * pixelCount);
+    uint8_t *out = buffer.data();
+
+    for (size_t i = 0; i < pixelCount; i++) {
+        memcpy(out + 4 * i, &palette[indexTable[i]], 4);
     }
 }
 
-void bsp::WADTexture::init(WADFile *pFile, WADDirEntry &dirEntry) {
-    m_pFile = pFile;
-    
+void bsp::WADTexture::init(const MappedFile &file, WADDirEntry &dirEntry) {
     if (dirEntry.nDiskSize != dirEntry.nSize) {
         throw WADFormatException(fmt::format("file '{}' size mismatch, disk = {}, real = {}",
                                              dirEntry.szName, dirEntry.nDiskSize, dirEntry.nSize));
     }
 
-    m_uFileOffset = dirEntry.nFilePos;
+    if (dirEntry.nFilePos < 0 || dirEntry.nDiskSize < (int32_t)sizeof(m_MipTex) ||
+        (size_t)dirEntry.nFilePos + dirEntry.nDiskSize > file.size()) {
+        throw WADFormatException(
+            fmt::format("file '{}' is out of bounds of the WAD", dirEntry.szName));
+    }
+
+    m_pData = file.data() + dirEntry.nFilePos;
     m_uFileSize = dirEntry.nDiskSize;
-    pFile->m_File.seekg(m_uFileOffset);
-    pFile->m_File.read(reinterpret_cast<char *>(&m_MipTex), sizeof(m_MipTex));
+    memcpy(&m_MipTex, m_pData, sizeof(m_MipTex));
     m_MipTex.szName[MAX_TEXTURE_NAME - 1] = '\0';
 }
 
-std::vector<uint8_t> bsp::WADTexture::readColorTable() const {
+const uint8_t *bsp::WADTexture::getColorTable() const {
     // 2 bytes after the last mipmap entry
-    unsigned offset = m_MipTex.nOffsets[MIP_LEVELS - 1] +
-                      (getWide() >> (MIP_LEVELS - 1)) * (getTall() >> (MIP_LEVELS - 1)) + 2;
+    size_t offset = (size_t)m_MipTex.nOffsets[MIP_LEVELS - 1] +
+                    (getWide() >> (MIP_LEVELS - 1)) * (getTall() >> (MIP_LEVELS - 1)) + 2;
 
     if (offset + WAD_COLORTABLE_SIZE_BYTES > m_uFileSize) {
         throw WADFormatException("No room for color table in the texture");
     }
 
-    std::vector<uint8_t> tbl(WAD_COLORTABLE_SIZE_BYTES);
-    m_pFile->m_File.seekg(m_uFileOffset + offset);
-    m_pFile->m_File.read(reinterpret_cast<char *>(tbl.data()), tbl.size());
-    return tbl;
+    return m_pData + offset;
 }
 
-std::vector<uint8_t> bsp::WADTexture::readIndexTable() const {
-    unsigned size = getWide() * getTall();
-    unsigned offset = m_MipTex.nOffsets[0];
+const uint8_t *bsp::WADTexture::getIndexTable() const {
+    size_t size = (size_t)getWide() * getTall();
+    size_t offset = m_MipTex.nOffsets[0];
 
     if (offset + size > m_uFileSize) {
         throw WADFormatException("No room for the index table");
     }
 
-    std::vector<uint8_t> data(size);
-    m_pFile->m_File.seekg(m_uFileOffset + offset);
-    m_pFile->m_File.read(reinterpret_cast<char *>(data.data()), data.size());
-    return data;
-}
-
-bsp::WADFile::WADFile() { 
-    m_File.exceptions(std::ifstream::failbit | std::ifstream::badbit | std::ifstream::eofbit);
+    return m_pData + offset;
 }
 
 void bsp::WADFile::loadFromFile(const fs::path &path) {
-    try {
-        m_File.open(path, std::ifstream::binary);
-
-        // Read WAD header
-        WADHeader wadHeader;
-        m_File.read(reinterpret_cast<char *>(&wadHeader), sizeof(wadHeader));
-
-        if (memcmp(wadHeader.szMagic, WAD3_MAGIC, sizeof(wadHeader.szMagic)) &&
-            memcmp(wadHeader.szMagic, WAD2_MAGIC, sizeof(wadHeader.szMagic))) {
-            throw WADFormatException(fmt::format("Magic is invalid. Expected WAD3/WAD2, got {}",
-                                                 std::string_view(wadHeader.szMagic, 4)));
-        }
-
-        // Read directory
-        if (wadHeader.nDir > MAX_WAD_TEXTURES) {
-            throw WADFormatException(
-                fmt::format("Too many textures ({} > {})", wadHeader.nDir, MAX_WAD_TEXTURES));
-        }
-
-        std::vector<WADDirEntry> files(wadHeader.nDir);
-        m_File.seekg(wadHeader.nDirOffset);
-        m_File.read(reinterpret_cast<char *>(files.data()), sizeof(WADDirEntry) * wadHeader.nDir);
-
-        // Create textures
-        m_Textures.resize(files.size());
-
-        for (size_t i = 0; i < files.size(); i++) {
-            // Make sure name is null-terminated
-            files[i].szName[MAX_TEXTURE_NAME - 1] = '\0';
-            m_Textures[i].init(this, files[i]);
-        }
-    } catch (const std::ios_base::failure &) {
-        if (m_File.eof()) {
-            throw WADFormatException("unexpected end of file");
-        } else {
-            throw;
-        }
+    m_File.open(path);
+
+    // Read WAD header
+    WADHeader wadHeader;
+
+    if (m_File.size() < sizeof(wadHeader)) {
+        throw WADFormatException("unexpected end of file");
+    }
+
+    memcpy(&wadHeader, m_File.data(), sizeof(wadHeader));
+
+    if (memcmp(wadHeader.szMagic, WAD3_MAGIC, sizeof(wadHeader.szMagic)) &&
+        memcmp(wadHeader.szMagic, WAD2_MAGIC, sizeof(wadHeader.szMagic))) {
+        throw WADFormatException(fmt::format("Magic is invalid. Expected WAD3/WAD2, got {}",
+                                             std::string_view(wadHeader.szMagic, 4)));
+    }
+
+    // Read directory
+    if (wadHeader.nDir < 0 || wadHeader.nDir > (int32_t)MAX_WAD_TEXTURES) {
+        throw WADFormatException(
+            fmt::format("Too many textures ({} > {})", wadHeader.nDir, MAX_WAD_TEXTURES));
+    }
+
+    size_t dirSize = sizeof(WADDirEntry) * wadHeader.nDir;
+
+    if (wadHeader.nDirOffset < 0 || (size_t)wadHeader.nDirOffset + dirSize > m_File.size()) {
+        throw WADFormatException("unexpected end of file");
+    }
+
+    std::vector<WADDirEntry> files(wadHeader.nDir);
+    memcpy(files.data(), m_File.data() + wadHeader.nDirOffset, dirSize);
+
+    // Create textures
+    m_Textures.resize(files.size());
+
+    for (size_t i = 0; i < files.size(); i++) {
+        // Make sure name is null-terminated
+        files[i].szName[MAX_TEXTURE_NAME - 1] = '\0';
+        m_Textures[i].init(m_File, files[i]);
+
+        // Index by name. If there are duplicates, first one is used.
+        std::string name = m_Textures[i].getName();
+        appfw::strToLower(name.begin(), name.end());
+        m_TextureIndex.emplace(std::move(name), i);
     }
 }
 
 void bsp::WADFile::close() {
     m_Textures.clear();
+    m_TextureIndex.clear();
     m_File.close();
 }
+
+const bsp::WADTexture *bsp::WADFile::findTexture(std::string_view name) const {
+    std::string lowerName(name);
+    appfw::strToLower(lowerName.begin(), lowerName.end());
+    auto it = m_TextureIndex.find(lowerName);
+    return it != m_TextureIndex.end() ? &m_Textures[it->second] : nullptr;
+}
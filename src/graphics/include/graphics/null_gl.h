@@ -0,0 +1,18 @@
+#ifndef GRAPHICS_NULL_GL_H
+#define GRAPHICS_NULL_GL_H
+
+//! Null OpenGL backend for machines without a GPU.
+//! Replaces OpenGL functions with stubs that don't need a context: objects get unique names,
+//! shaders compile, framebuffers are complete and nothing is drawn.
+//! Graphics wrappers track VRAM usage the same way as with a real context.
+namespace NullGL {
+
+//! Loads the stubs into glad. Must be called instead of gladLoadGL.
+void load();
+
+//! @returns whether the null backend is loaded.
+bool isLoaded();
+
+} // namespace NullGL
+
+#endif
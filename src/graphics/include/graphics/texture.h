@@ -37,6 +37,7 @@ enum class GraphicsFormat
     RGBA8,
     RGB16F,
     RGBA16F,
+    RGB9E5,
     SRGB8,
     SRGB8_ALPHA8,
     Depth16,
@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <cstring>
+#include <glad/glad.h>
+#include <graphics/null_gl.h>
+
+// Functions used by the graphics wrappers, the renderer and ImGui.
+// clang-format off
+#define NULL_GL_FUNCTIONS(X) \
+    X(ActiveTexture) X(AttachShader) X(BindBuffer) X(BindBufferBase) X(BindFramebuffer) \
+    X(BindRenderbuffer) X(BindSampler) X(BindTexture) X(BindVertexArray) X(BlendEquation) \
+    X(BlendEquationSeparate) X(BlendFunc) X(BlendFuncSeparate) X(BlitFramebuffer) X(BufferData) \
+    X(BufferSubData) X(CheckFramebufferStatus) X(Clear) X(ClearColor) X(CompileShader) \
+    X(CreateProgram) X(CreateShader) X(CullFace) X(DeleteBuffers) X(DeleteFramebuffers) \
+    X(DeleteProgram) X(DeleteRenderbuffers) X(DeleteShader) X(DeleteTextures) \
+    X(DeleteVertexArrays) X(DepthFunc) X(DetachShader) X(Disable) X(DrawArrays) \
+    X(DrawArraysInstanced) X(DrawElements) X(DrawElementsBaseVertex) X(Enable) \
+    X(EnableVertexAttribArray) X(Finish) X(FramebufferRenderbuffer) X(FramebufferTexture2D) \
+    X(FrontFace) X(GenBuffers) X(GenFramebuffers) X(GenRenderbuffers) X(GenTextures) \
+    X(GenVertexArrays) X(GenerateMipmap) X(GetActiveUniform) X(GetError) X(GetFloatv) \
+    X(GetIntegerv) X(GetProgramInfoLog) X(GetProgramiv) X(GetShaderInfoLog) X(GetShaderiv) \
+    X(GetString) X(GetStringi) X(GetTexImage) X(GetUniformBlockIndex) X(GetUniformLocation) \
+    X(IsEnabled) X(LineWidth) X(LinkProgram) X(MultiDrawArrays) X(PixelStorei) X(PolygonMode) \
+    X(PrimitiveRestartIndex) X(ReadPixels) X(RenderbufferStorage) \
+    X(RenderbufferStorageMultisample) X(Scissor) X(ShaderSource) X(TexBuffer) X(TexImage2D) \
+    X(TexImage2DMultisample) X(TexImage3D) X(TexParameterf) X(TexParameteri) X(TexSubImage2D) \
+    X(TexSubImage3D) X(Uniform1f) X(Uniform1i) X(Uniform1iv) X(Uniform2f) X(Uniform3f) \
+    X(Uniform3fv) X(Uniform4f) X(Uniform4fv) X(UniformBlockBinding) X(UniformMatrix4fv) \
+    X(UseProgram) X(VertexAttribDivisor) X(VertexAttribIPointer) X(VertexAttribPointer) \
+    X(Viewport)
+// clang-format on
+
+namespace {
+
+bool s_bIsLoaded = false;
+GLuint s_uLastName = 0;
+
+//! Does nothing, returns zero.
+template <typename R, typename... Args>
+R APIENTRY nullFunc(Args...) {
+    return R();
+}
+
+template <typename R, typename... Args>
+void setNullFunc(R(APIENTRY *&func)(Args...)) {
+    func = &nullFunc<R, Args...>;
+}
+
+GLuint newName() {
+    return ++s_uLastName;
+}
+
+void APIENTRY genNames(GLsizei n, GLuint *names) {
+    for (GLsizei i = 0; i < n; i++) {
+        names[i] = newName();
+    }
+}
+
+GLuint APIENTRY createObject() {
+    return newName();
+}
+
+GLuint APIENTRY createShader(GLenum) {
+    return newName();
+}
+
+GLenum APIENTRY checkFramebufferStatus(GLenum) {
+    return GL_FRAMEBUFFER_COMPLETE;
+}
+
+void APIENTRY getIntegerv(GLenum pname, GLint *data) {
+    switch (pname) {
+    case GL_MAJOR_VERSION:
+    case GL_MINOR_VERSION:
+        data[0] = 3;
+        break;
+    case GL_CONTEXT_PROFILE_MASK:
+        data[0] = GL_CONTEXT_CORE_PROFILE_BIT;
+        break;
+    case GL_MAX_TEXTURE_SIZE:
+    case GL_MAX_RENDERBUFFER_SIZE:
+        data[0] = 16384;
+        break;
+    case GL_MAX_ARRAY_TEXTURE_LAYERS:
+        data[0] = 2048;
+        break;
+    case GL_MAX_TEXTURE_BUFFER_SIZE:
+        data[0] = 1 << 27;
+        break;
+    case GL_MAX_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS:
+    case GL_MAX_UNIFORM_BUFFER_BINDINGS:
+        data[0] = 32;
+        break;
+    case GL_VIEWPORT:
+    case GL_SCISSOR_BOX:
+        std::fill(data, data + 4, 0);
+        break;
+    case GL_POLYGON_MODE:
+        data[0] = data[1] = GL_FILL;
+        break;
+    default:
+        data[0] = 0;
+        break;
+    }
+}
+
+void APIENTRY getFloatv(GLenum pname, GLfloat *data) {
+    switch (pname) {
+    case GL_MAX_TEXTURE_MAX_ANISOTROPY:
+        data[0] = 16;
+        break;
+    case GL_COLOR_CLEAR_VALUE:
+        std::fill(data, data + 4, 0.0f);
+        break;
+    default:
+        data[0] = 0;
+        break;
+    }
+}
+
+void APIENTRY getObjectiv(GLuint, GLenum pname, GLint *params) {
+    switch (pname) {
+    case GL_COMPILE_STATUS:
+    case GL_LINK_STATUS:
+        params[0] = GL_TRUE;
+        break;
+    default:
+        params[0] = 0;
+        break;
+    }
+}
+
+void APIENTRY getInfoLog(GLuint, GLsizei bufSize, GLsizei *length, GLchar *infoLog) {
+    if (length) {
+        *length = 0;
+    }
+
+    if (bufSize > 0) {
+        infoLog[0] = '\0';
+    }
+}
+
+const GLubyte *APIENTRY getString(GLenum name) {
+    switch (name) {
+    case GL_VENDOR:
+        return reinterpret_cast<const GLubyte *>("None");
+    case GL_RENDERER:
+        return reinterpret_cast<const GLubyte *>("Null Renderer");
+    case GL_VERSION:
+        return reinterpret_cast<const GLubyte *>("3.3 Null");
+    case GL_SHADING_LANGUAGE_VERSION:
+        return reinterpret_cast<const GLubyte *>("3.30");
+    default:
+        return reinterpret_cast<const GLubyte *>("");
+    }
+}
+
+const GLubyte *APIENTRY getStringi(GLenum, GLuint) {
+    return reinterpret_cast<const GLubyte *>("");
+}
+
+void APIENTRY readPixels(GLint, GLint, GLsizei width, GLsizei height, GLenum format, GLenum type,
+                         void *pixels) {
+    // Read back black pixels
+    size_t components = 4;
+
+    switch (format) {
+    case GL_RED:
+    case GL_DEPTH_COMPONENT:
+        components = 1;
+        break;
+    case GL_RG:
+        components = 2;
+        break;
+    case GL_RGB:
+    case GL_BGR:
+        components = 3;
+        break;
+    }
+
+    size_t componentSize = (type == GL_FLOAT || type == GL_UNSIGNED_INT || type == GL_INT) ? 4 : 1;
+    memset(pixels, 0, (size_t)width * height * components * componentSize);
+}
+
+} // namespace
+
+void NullGL::load() {
+#define NULL_GL_SET_FUNC(name) setNullFunc(glad_gl##name);
+    NULL_GL_FUNCTIONS(NULL_GL_SET_FUNC)
+#undef NULL_GL_SET_FUNC
+
+    glad_glGenBuffers = &genNames;
+    glad_glGenFramebuffers = &genNames;
+    glad_glGenRenderbuffers = &genNames;
+    glad_glGenTextures = &genNames;
+    glad_glGenVertexArrays = &genNames;
+    glad_glCreateProgram = &createObject;
+    glad_glCreateShader = &createShader;
+    glad_glCheckFramebufferStatus = &checkFramebufferStatus;
+    glad_glGetIntegerv = &getIntegerv;
+    glad_glGetFloatv = &getFloatv;
+    glad_glGetShaderiv = &getObjectiv;
+    glad_glGetProgramiv = &getObjectiv;
+    glad_glGetShaderInfoLog = &getInfoLog;
+    glad_glGetProgramInfoLog = &getInfoLog;
+    glad_glGetString = &getString;
+    glad_glGetStringi = &getStringi;
+    glad_glReadPixels = &readPixels;
+
+    GLVersion.major = 3;
+    GLVersion.minor = 3;
+    GLAD_GL_VERSION_1_0 = GLAD_GL_VERSION_1_1 = GLAD_GL_VERSION_1_2 = GLAD_GL_VERSION_1_3 = 1;
+    GLAD_GL_VERSION_1_4 = GLAD_GL_VERSION_1_5 = GLAD_GL_VERSION_2_0 = GLAD_GL_VERSION_2_1 = 1;
+    GLAD_GL_VERSION_3_0 = GLAD_GL_VERSION_3_1 = GLAD_GL_VERSION_3_2 = GLAD_GL_VERSION_3_3 = 1;
+    GLAD_GL_ARB_texture_filter_anisotropic = 1;
+
+    s_bIsLoaded = true;
+}
+
+bool NullGL::isLoaded() {
+    return s_bIsLoaded;
+}
@@ -158,6 +158,8 @@ GLenum Texture::graphicsFormatToGL(GraphicsFormat format) {
         return GL_RGB16F;
     case GraphicsFormat::RGBA16F:
         return GL_RGBA16F;
+    case GraphicsFormat::RGB9E5:
+        return GL_RGB9_E5;
     case GraphicsFormat::SRGB8:
         return GL_SRGB8;
     case GraphicsFormat::SRGB8_ALPHA8:
@@ -41,6 +41,7 @@ int64_t Texture2D::calcTextureMemUsage(GraphicsFormat internalFormat, int wide,
     case GraphicsFormat::RG16F:
     case GraphicsFormat::RGB8:
     case GraphicsFormat::RGBA8:
+    case GraphicsFormat::RGB9E5:
     case GraphicsFormat::SRGB8:
     case GraphicsFormat::SRGB8_ALPHA8:
     case GraphicsFormat::Depth24:
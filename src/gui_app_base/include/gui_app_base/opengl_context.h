@@ -8,6 +8,10 @@ public:
     //! Sets the window attributes before window creation.
     static void setupWindowAttributes();
 
+    //! @returns whether the null backend was requested with --null-gl.
+    //! No context is created then, see NullGL.
+    static bool isNullBackend();
+
     OpenGLContext();
     ~OpenGLContext();
 
@@ -18,6 +18,11 @@ GuiAppBase::GuiAppBase()
 
     // Set VSync cvar callback
     app_vsync.setCallback([](const bool &, const bool &newVal) {
+        if (OpenGLContext::isNullBackend()) {
+            // No swap chain
+            return true;
+        }
+
         if (newVal) {
             // Try adaptive sync
             if (SDL_GL_SetSwapInterval(-1) == 0) {
@@ -101,7 +106,9 @@ void GuiAppBase::refreshScreen() {
             saveSnapshot();
         }
 
-        SDL_GL_SwapWindow(m_MainWindow.getWindow());
+        if (!OpenGLContext::isNullBackend()) {
+            SDL_GL_SwapWindow(m_MainWindow.getWindow());
+        }
     }
 }
 
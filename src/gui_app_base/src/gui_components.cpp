@@ -34,7 +34,13 @@ MainWindowComponent::MainWindowComponent() {
     int tall = cfg.get<int>("win_height");
     cfg_window_width.setDefaultValue(wide);
     cfg_window_height.setDefaultValue(tall);
-    Uint32 flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI;
+    Uint32 flags = SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI;
+
+    if (!OpenGLContext::isNullBackend()) {
+        // Null backend must not require libGL
+        flags |= SDL_WINDOW_OPENGL;
+    }
+
     m_pWindow = SDL_CreateWindow(cfg.get<std::string>("win_title").c_str(), SDL_WINDOWPOS_CENTERED,
                                  SDL_WINDOWPOS_CENTERED, wide, tall, flags);
 
@@ -108,7 +114,12 @@ ImGuiComponent::ImGuiComponent() {
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard; // Enable Keyboard Controls
     // io.ConfigFlags |= ImGuiConfigFlags_NavEnableGamepad;      // Enable Gamepad Controls
     io.ConfigFlags |= ImGuiConfigFlags_DockingEnable;   // Enable Docking
-    io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable; // Enable Multi-Viewport / Platform Windows
+
+    if (!OpenGLContext::isNullBackend()) {
+        // Multi-Viewport / Platform Windows. They need real GL contexts.
+        io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;
+    }
+
     // io.ConfigViewportsNoAutoMerge = true;
     // io.ConfigViewportsNoTaskBarIcon = true;
 
@@ -130,6 +141,7 @@ ImGuiComponent::ImGuiComponent() {
     }
 
     // Setup Platform/Renderer bindings
+    // glContext is null with the null backend. It's only used by platform windows.
     ImGui_ImplSDL2_InitForOpenGL(pWindow, glContext);
     ImGui_ImplOpenGL3_Init();
 
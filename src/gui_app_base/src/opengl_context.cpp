@@ -1,4 +1,5 @@
 #include "SDL.h"
+#include <graphics/null_gl.h>
 #include <gui_app_base/gui_app_base.h>
 #include <gui_app_base/opengl_context.h>
 
@@ -10,6 +11,10 @@ static ConVar<bool> gl_break_on_error("gl_break_on_error", true,
 #endif
 
 void OpenGLContext::setupWindowAttributes() {
+    if (isNullBackend()) {
+        return;
+    }
+
     if (SDL_GL_LoadLibrary(nullptr)) {
         app_fatalError("Failed to load OpenGL library: {}", SDL_GetError());
     }
@@ -30,7 +35,17 @@ void OpenGLContext::setupWindowAttributes() {
     SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, contextFlags);
 }
 
+bool OpenGLContext::isNullBackend() {
+    return getCommandLine().isFlagSet("--null-gl");
+}
+
 OpenGLContext::OpenGLContext() {
+    if (isNullBackend()) {
+        NullGL::load();
+        printw("OpenGL: Using null backend, nothing will be drawn");
+        return;
+    }
+
     SDL_Window *pWindow = MainWindowComponent::get().getWindow();
 
     // Create OpenGL context
@@ -86,8 +101,10 @@ OpenGLContext::OpenGLContext() {
 }
 
 OpenGLContext::~OpenGLContext() {
-    SDL_GL_DeleteContext(m_GLContext);
-    m_GLContext = nullptr;
+    if (m_GLContext) {
+        SDL_GL_DeleteContext(m_GLContext);
+        m_GLContext = nullptr;
+    }
 }
 
 void OpenGLContext::gladPostCallback(const char *name, void *, int, ...) {
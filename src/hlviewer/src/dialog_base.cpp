@@ -27,7 +27,7 @@ void DialogBase::tick() {
     ImGui::End();
 }
 
-void DialogBase::preRender() {}
+void DialogBase::preRender(std::vector<SceneView *> &) {}
 
 void DialogBase::setTitle(std::string_view title) {
     m_Title = title;
@@ -1,6 +1,9 @@
 #ifndef DIALOG_BASE_H
 #define DIALOG_BASE_H
 #include <string_view>
+#include <vector>
+
+class SceneView;
 
 class DialogBase {
 public:
@@ -11,7 +14,9 @@ public:
     virtual void tick();
 
     //! Called before rendering ImGui.
-    virtual void preRender();
+    //! @param  sceneViews  Scene views that need to be rendered this frame are added here.
+    //!                     They are rendered together after all dialogs.
+    virtual void preRender(std::vector<SceneView *> &sceneViews);
 
     //! Brings the dialog to front.
     inline void bringToFront() { m_bBringToFront = true; }
@@ -97,9 +97,14 @@ void HLViewer::tick() {
 void HLViewer::drawBackground() {
     BaseClass::drawBackground();
 
+    // Views of all dialogs are rendered together so their visibility is determined in parallel
+    std::vector<SceneView *> sceneViews;
+
     for (auto &dialog : m_Dialogs) {
-        dialog->preRender();
+        dialog->preRender(sceneViews);
     }
+
+    SceneView::renderBackBuffers({sceneViews.data(), sceneViews.size()});
 }
 
 void HLViewer::showDialogs() {
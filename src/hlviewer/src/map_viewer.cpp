@@ -51,11 +51,11 @@ void MapViewer::tick() {
     }
 }
 
-void MapViewer::preRender() {
+void MapViewer::preRender(std::vector<SceneView *> &sceneViews) {
     if (isContentVisible() && m_pSceneView) {
         m_pSceneView->setFov(m_flFov);
         m_pSceneView->setShowTriggers(m_bShowTriggers);
-        m_pSceneView->renderBackBuffer();
+        sceneViews.push_back(m_pSceneView.get());
     }
 }
 
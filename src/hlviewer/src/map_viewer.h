@@ -9,7 +9,7 @@ class MapViewer : public DialogBase {
 public:
     MapViewer(std::string_view path);
     void tick() override;
-    void preRender() override;
+    void preRender(std::vector<SceneView *> &sceneViews) override;
 
 protected:
     void showContents() override;
@@ -92,10 +92,10 @@ public:
         }
     }
 
-    void preRender() {
+    void preRender(std::vector<SceneView *> &sceneViews) {
         if (m_pView) {
             m_pView->setFov(90);
-            m_pView->renderBackBuffer();
+            sceneViews.push_back(m_pView.get());
         }
     }
 
@@ -198,11 +198,11 @@ SpriteViewer::SpriteViewer(std::string_view path) {
     }
 }
 
-void SpriteViewer::preRender() {
-    DialogBase::preRender();
+void SpriteViewer::preRender(std::vector<SceneView *> &sceneViews) {
+    DialogBase::preRender(sceneViews);
 
     if (m_p3DView) {
-        m_p3DView->preRender();
+        m_p3DView->preRender(sceneViews);
     }
 }
 
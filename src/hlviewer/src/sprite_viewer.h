@@ -11,7 +11,7 @@ class SpriteViewer : public DialogBase {
 public:
     SpriteViewer(std::string_view path);
 
-    void preRender() override;
+    void preRender(std::vector<SceneView *> &sceneViews) override;
 
 protected:
     void showContents() override;
@@ -114,6 +114,10 @@ public:
     inline int getFxAmount() { return m_iFxAmount; }
     inline const glm::ivec3 &getFxColor() { return m_vFxColor; }
 
+    //! @returns whether the entity is a brush entity that never moves or changes its look.
+    //! Such entities can be drawn as a part of the world.
+    bool isStaticBrush();
+
     //! Converts angles (pitch, yaw, roll) into a quaternion.
     static glm::quat anglesToQuat(glm::vec3 angles);
 
@@ -155,6 +159,9 @@ private:
 
     //! Updates the AABB.
     void updateAABB();
+
+    //! Notifies Vis that the entity has moved.
+    void onBoundsChanged();
 };
 
 #endif
\ No newline at end of file
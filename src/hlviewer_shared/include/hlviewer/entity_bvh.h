@@ -0,0 +1,132 @@
+#ifndef HLVIEWER_ENTITY_BVH_H
+#define HLVIEWER_ENTITY_BVH_H
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+class BaseEntity;
+
+//! Bounding volume hierarchy over world-space bounds of entities.
+//! Used as a broad phase for entity raycasts.
+//! Bounds of changed entities are refitted in place, the tree is rebuilt when entities are added.
+class EntityBVH {
+public:
+    using EntityList = std::vector<std::unique_ptr<BaseEntity>>;
+
+    //! Builds the tree over all entities.
+    void build(const EntityList &ents);
+
+    //! Rebuilds the tree if entity count has changed or refits bounds of invalidated entities.
+    void update(const EntityList &ents);
+
+    //! Marks bounds of the entity as changed. They will be refitted on next update.
+    void invalidateEntity(int entIdx);
+
+    //! Finds entities whose bounds are hit by the ray closer than maxDist.
+    //! @param  direction   Normalized direction of the ray
+    //! @param  fn          Called with entity index, returns new maxDist
+    template <typename F>
+    void raycast(glm::vec3 origin, glm::vec3 direction, float maxDist, F fn) const;
+
+    //! Calculates world-space bounds of an entity.
+    //! @returns false if the entity can't be hit by raycasts.
+    static bool getEntityBounds(BaseEntity *pEnt, glm::vec3 &mins, glm::vec3 &maxs);
+
+private:
+    //! Maximum number of entities in a leaf.
+    static constexpr unsigned MAX_LEAF_ENTS = 4;
+
+    //! Maximum depth of the tree. Median split keeps it balanced.
+    static constexpr int MAX_DEPTH = 64;
+
+    struct Bounds {
+        glm::vec3 mins = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 maxs = glm::vec3(std::numeric_limits<float>::lowest());
+
+        inline void add(const Bounds &other) {
+            mins = glm::min(mins, other.mins);
+            maxs = glm::max(maxs, other.maxs);
+        }
+
+        inline bool isEmpty() const { return mins.x > maxs.x; }
+    };
+
+    struct Node {
+        Bounds bounds;
+        int iParent = -1;
+        int iChildren[2] = {-1, -1};
+        unsigned uFirstItem = 0;
+        unsigned uItemCount = 0; //!< Not 0 for leaves
+    };
+
+    std::vector<Node> m_Nodes;
+    std::vector<int> m_Items;         //!< Entity indices referenced by leaves
+    std::vector<Bounds> m_EntBounds;  //!< World bounds of each entity
+    std::vector<int> m_EntLeaves;     //!< Leaf node of each entity
+    std::vector<int> m_DirtyEnts;     //!< Entities with changed bounds
+    std::vector<uint8_t> m_IsDirty;   //!< Whether entity is in m_DirtyEnts
+    size_t m_uBuiltEntCount = 0;
+    bool m_bIsBuilt = false;
+
+    //! Builds the subtree for items [begin; end).
+    //! @returns node index
+    int buildNode(unsigned begin, unsigned end, int parent, int depth);
+
+    //! Recalculates bounds of a leaf from its entities and propagates them up.
+    void refitLeaf(int nodeIdx);
+
+    //! @returns whether the ray hits the box closer than maxDist.
+    static bool rayHitsBox(glm::vec3 origin, glm::vec3 invDir, const Bounds &box, float maxDist);
+};
+
+template <typename F>
+inline void EntityBVH::raycast(glm::vec3 origin, glm::vec3 direction, float maxDist, F fn) const {
+    if (m_Nodes.empty()) {
+        return;
+    }
+
+    // Avoid 0 * inf = NaN in slab tests
+    constexpr float MIN_DIR = 1e-20f;
+    glm::vec3 invDir;
+
+    for (int i = 0; i < 3; i++) {
+        float d = direction[i];
+
+        if (std::abs(d) < MIN_DIR) {
+            d = d < 0 ? -MIN_DIR : MIN_DIR;
+        }
+
+        invDir[i] = 1.0f / d;
+    }
+
+    int stack[MAX_DEPTH];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0) {
+        const Node &node = m_Nodes[stack[--stackSize]];
+
+        if (!rayHitsBox(origin, invDir, node.bounds, maxDist)) {
+            continue;
+        }
+
+        if (node.uItemCount != 0) {
+            for (unsigned i = 0; i < node.uItemCount; i++) {
+                int entIdx = m_Items[node.uFirstItem + i];
+
+                if (!m_EntBounds[entIdx].isEmpty() &&
+                    rayHitsBox(origin, invDir, m_EntBounds[entIdx], maxDist)) {
+                    maxDist = fn(entIdx);
+                }
+            }
+        } else {
+            stack[stackSize++] = node.iChildren[0];
+            stack[stackSize++] = node.iChildren[1];
+        }
+    }
+}
+
+#endif
@@ -13,7 +13,9 @@ public:
     SceneView(LevelAsset &level);
 
     //! Sets the WorldStateBase instance to be used by the renderer.
-    inline void setWorldState(WorldStateBase *ws) { m_pWorldState = ws; }
+    //! Static brush entities are merged into the world. They are hidden by r_drawworld 0 and
+    //! r_drawents 0 and don't count towards MAX_VISIBLE_ENTS.
+    void setWorldState(WorldStateBase *ws);
 
     //! Loads and sets the sky texture
     void setSkyTexture(std::string_view skyname);
@@ -28,6 +30,11 @@ public:
     //! Must be called before ImGui is displayed.
     void renderBackBuffer();
 
+    //! Renders viewports of several views into their backbuffers.
+    //! Visibility of the views is determined in parallel, rendering is done on this thread.
+    //! Must be called before ImGui is displayed.
+    static void renderBackBuffers(appfw::span<SceneView *const> views);
+
     //! @returns a ray cast from the view origin into a screen pixel.
     //! @param  pos     Screen position in pixels, origin - top left corner.
     Ray viewportPointToRay(const glm::vec2 &pos);
@@ -110,6 +117,7 @@ private:
 
     // Entities to render
     std::vector<ClientEntity> m_VisEnts;
+    std::vector<uint8_t> m_IsEntMerged; //!< Whether the entity is drawn as a part of the world
     std::vector<BoxInstance> m_BoxInstancesData;
     unsigned m_uBoxCount = 0;
 
@@ -140,6 +148,12 @@ private:
 
     void setViewportSize(glm::ivec2 newSize);
 
+    //! Sets up the view context and fills entity lists for rendering.
+    void setupSceneRendering();
+
+    //! Renders the prepared scene into the backbuffer.
+    void renderScene();
+
     static inline std::weak_ptr<SharedData> m_spSharedDataWeakPtr;
 };
 
@@ -2,6 +2,7 @@
 #define VIS_H
 #include <appfw/utils.h>
 #include <bsp/level.h>
+#include <hlviewer/entity_bvh.h>
 
 class WorldStateBase;
 
@@ -63,6 +64,27 @@ public:
     bool raycastToEntity(const Ray &ray, EntityRaycastHit &hit, bool ignoreTriggers,
                          float maxDist = MAX_RAYCAST_DIST);
 
+    //! Casts rays to world or entity surfaces in parallel. Same as raycastToSurface for each ray.
+    //! Entities must not be modified during the call.
+    //! @param  hits    Results for each ray, must be the same size as rays
+    void raycastToSurfaceBatch(appfw::span<const Ray> rays, appfw::span<SurfaceRaycastHit> hits,
+                               bool ignoreTriggers, float maxDist = MAX_RAYCAST_DIST);
+
+    //! Casts rays to world surfaces in parallel. Same as raycastToWorldSurface for each ray.
+    //! @param  hits    Results for each ray, must be the same size as rays
+    void raycastToWorldSurfaceBatch(appfw::span<const Ray> rays,
+                                    appfw::span<SurfaceRaycastHit> hits,
+                                    float maxDist = MAX_RAYCAST_DIST);
+
+    //! Casts rays to entities in parallel. Same as raycastToEntity for each ray.
+    //! Entities must not be modified during the call.
+    //! @param  hits    Results for each ray, must be the same size as rays
+    void raycastToEntityBatch(appfw::span<const Ray> rays, appfw::span<EntityRaycastHit> hits,
+                              bool ignoreTriggers, float maxDist = MAX_RAYCAST_DIST);
+
+    //! Marks bounds of an entity as changed. Called by the entity when it is moved or resized.
+    void invalidateEntityBounds(int entIdx);
+
     //! Casts a ray to an AABB.
     //! @param  ray         The ray
     //! @param  mins        Min bounds
@@ -74,6 +96,9 @@ public:
 private:
     static constexpr int MAX_BOX_LEAFS = 256;
 
+    //! Number of rays processed by a worker at once in batch raycasts.
+    static constexpr size_t BATCH_CHUNK_SIZE = 64;
+
     struct LeafList {
         int count;
         int maxcount;
@@ -86,6 +111,7 @@ private:
     WorldStateBase &m_WorldState;
     const bsp::Level *m_pLevel = nullptr;
     std::array<uint8_t, bsp::MAX_MAP_LEAFS / 8> m_VisBuf;
+    EntityBVH m_EntityBVH;
 
     //! Returns true if AABB is visible in VIS.
     bool isBoxVisible(const glm::vec3 &mins, const glm::vec3 &maxs, const uint8_t *visbits);
@@ -96,6 +122,17 @@ private:
     void boxLeafNums_r(LeafList &ll, int node);
 
     void raycastRecursiveWorldNodes(int node, const Ray &ray, SurfaceRaycastHit &hit);
+
+    //! Raycast functions that expect the entity BVH to be up to date.
+    //! Can be called from multiple threads.
+    bool castToSurface(const Ray &ray, SurfaceRaycastHit &hit, bool ignoreTriggers, float maxDist);
+    bool castToEntitySurface(const Ray &ray, SurfaceRaycastHit &hit, bool ignoreTriggers,
+                             float maxDist);
+    bool castToEntity(const Ray &ray, EntityRaycastHit &hit, bool ignoreTriggers, float maxDist);
+
+    //! Calls fn(i) for i in [0; count) on the app's executor.
+    template <typename F>
+    void runBatch(size_t count, F fn);
 };
 
 #endif
@@ -61,16 +61,7 @@ std::string WADAsset::extractNameFromPath(std::string_view path) {
 
 
 const bsp::WADTexture *WADAsset::findTexture(const char *name) {
-    auto &list = m_File.getTextures();
-    auto it = std::find_if(list.begin(), list.end(), [name](const bsp::WADTexture &tex) {
-        return !appfw::strcasecmp(tex.getName(), name);
-    });
-
-    if (it == list.end()) {
-        return nullptr;
-    } else {
-        return &(*it);
-    }
+    return m_File.findTexture(name);
 }
 
 void WADAsset::loadFromFile(AssetManager &assMgr, std::string_view path, std::string_view wadName) {
@@ -152,6 +152,28 @@ void BaseEntity::setModel(std::string_view model) {
 
 void BaseEntity::setModel(Model *model) {
     m_pModel = model;
+    onBoundsChanged();
+}
+
+bool BaseEntity::isStaticBrush() {
+    if (m_ClassName != "func_wall" && m_ClassName != "func_illusionary") {
+        return false;
+    }
+
+    if (!m_pModel || m_pModel->type != ModelType::Brush || m_bIsTrigger) {
+        return false;
+    }
+
+    // Named entities can be toggled by other entities
+    if (!m_TargetName.empty()) {
+        return false;
+    }
+
+    if (m_nRenderMode != kRenderNormal || m_nRenderFx != kRenderFxNone) {
+        return false;
+    }
+
+    return m_vOrigin == glm::vec3(0, 0, 0) && m_vAngles == glm::vec3(0, 0, 0);
 }
 
 void BaseEntity::setRenderMode(RenderMode mode) {
@@ -205,4 +227,12 @@ void BaseEntity::updateAABB() {
         m_AABBPos = (maxs + mins) / 2.0f;
         m_AABBHalfExtents = maxs - m_AABBPos;
     }
+
+    onBoundsChanged();
+}
+
+void BaseEntity::onBoundsChanged() {
+    if (m_pWorldState) {
+        m_pWorldState->getVis().invalidateEntityBounds(m_iEntIndex);
+    }
 }
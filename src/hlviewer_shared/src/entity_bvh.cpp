@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <hlviewer/brush_model.h>
+#include <hlviewer/entity_bvh.h>
+#include <hlviewer/entities/base_entity.h>
+
+void EntityBVH::build(const EntityList &ents) {
+    m_Nodes.clear();
+    m_Items.clear();
+    m_DirtyEnts.clear();
+    m_EntBounds.resize(ents.size());
+    m_EntLeaves.assign(ents.size(), -1);
+    m_IsDirty.assign(ents.size(), 0);
+
+    for (size_t i = 0; i < ents.size(); i++) {
+        Bounds &bounds = m_EntBounds[i];
+        bounds = Bounds();
+        getEntityBounds(ents[i].get(), bounds.mins, bounds.maxs);
+        m_Items.push_back((int)i);
+    }
+
+    if (!m_Items.empty()) {
+        m_Nodes.reserve(2 * (m_Items.size() / MAX_LEAF_ENTS + 1));
+        buildNode(0, (unsigned)m_Items.size(), -1, 0);
+    }
+
+    m_uBuiltEntCount = ents.size();
+    m_bIsBuilt = true;
+}
+
+void EntityBVH::update(const EntityList &ents) {
+    if (!m_bIsBuilt || m_uBuiltEntCount != ents.size()) {
+        build(ents);
+        return;
+    }
+
+    for (int entIdx : m_DirtyEnts) {
+        Bounds &bounds = m_EntBounds[entIdx];
+        bounds = Bounds();
+        getEntityBounds(ents[entIdx].get(), bounds.mins, bounds.maxs);
+        m_IsDirty[entIdx] = 0;
+        refitLeaf(m_EntLeaves[entIdx]);
+    }
+
+    m_DirtyEnts.clear();
+}
+
+void EntityBVH::invalidateEntity(int entIdx) {
+    if (!m_bIsBuilt || entIdx < 0 || (size_t)entIdx >= m_uBuiltEntCount) {
+        // New entities are added on rebuild
+        return;
+    }
+
+    if (!m_IsDirty[entIdx]) {
+        m_IsDirty[entIdx] = 1;
+        m_DirtyEnts.push_back(entIdx);
+    }
+}
+
+bool EntityBVH::getEntityBounds(BaseEntity *pEnt, glm::vec3 &mins, glm::vec3 &maxs) {
+    if (pEnt->useAABB()) {
+        mins = pEnt->getOrigin() + pEnt->getAABBPos() - pEnt->getAABBHalfExtents();
+        maxs = pEnt->getOrigin() + pEnt->getAABBPos() + pEnt->getAABBHalfExtents();
+        return true;
+    }
+
+    Model *pModel = pEnt->getModel();
+
+    if (pModel && pModel->type == ModelType::Brush) {
+        mins = pEnt->getOrigin() + pModel->vMins;
+        maxs = pEnt->getOrigin() + pModel->vMaxs;
+        return true;
+    }
+
+    return false;
+}
+
+int EntityBVH::buildNode(unsigned begin, unsigned end, int parent, int depth) {
+    int nodeIdx = (int)m_Nodes.size();
+    m_Nodes.emplace_back();
+    m_Nodes[nodeIdx].iParent = parent;
+
+    // Calculate bounds of the node and of entity centers
+    Bounds bounds, centers;
+
+    for (unsigned i = begin; i < end; i++) {
+        const Bounds &entBounds = m_EntBounds[m_Items[i]];
+
+        if (!entBounds.isEmpty()) {
+            bounds.add(entBounds);
+            glm::vec3 center = (entBounds.mins + entBounds.maxs) * 0.5f;
+            centers.add({center, center});
+        }
+    }
+
+    m_Nodes[nodeIdx].bounds = bounds;
+
+    // Make a leaf
+    if (end - begin <= MAX_LEAF_ENTS || depth >= MAX_DEPTH - 2) {
+        Node &node = m_Nodes[nodeIdx];
+        node.uFirstItem = begin;
+        node.uItemCount = end - begin;
+
+        for (unsigned i = begin; i < end; i++) {
+            m_EntLeaves[m_Items[i]] = nodeIdx;
+        }
+
+        return nodeIdx;
+    }
+
+    // Split at the median of the longest axis
+    int axis = 0;
+
+    if (!centers.isEmpty()) {
+        glm::vec3 size = centers.maxs - centers.mins;
+
+        if (size.y > size[axis]) {
+            axis = 1;
+        }
+
+        if (size.z > size[axis]) {
+            axis = 2;
+        }
+    }
+
+    auto fnCenter = [&](int entIdx) {
+        const Bounds &entBounds = m_EntBounds[entIdx];
+        return entBounds.isEmpty() ? 0.0f : entBounds.mins[axis] + entBounds.maxs[axis];
+    };
+
+    unsigned mid = begin + (end - begin) / 2;
+    std::nth_element(m_Items.begin() + begin, m_Items.begin() + mid, m_Items.begin() + end,
+                     [&](int lhs, int rhs) { return fnCenter(lhs) < fnCenter(rhs); });
+
+    int left = buildNode(begin, mid, nodeIdx, depth + 1);
+    int right = buildNode(mid, end, nodeIdx, depth + 1);
+    m_Nodes[nodeIdx].iChildren[0] = left;
+    m_Nodes[nodeIdx].iChildren[1] = right;
+
+    return nodeIdx;
+}
+
+void EntityBVH::refitLeaf(int nodeIdx) {
+    Node &leaf = m_Nodes[nodeIdx];
+    leaf.bounds = Bounds();
+
+    for (unsigned i = 0; i < leaf.uItemCount; i++) {
+        const Bounds &entBounds = m_EntBounds[m_Items[leaf.uFirstItem + i]];
+
+        if (!entBounds.isEmpty()) {
+            leaf.bounds.add(entBounds);
+        }
+    }
+
+    // Propagate to the root
+    for (int i = leaf.iParent; i != -1; i = m_Nodes[i].iParent) {
+        Node &node = m_Nodes[i];
+        node.bounds = m_Nodes[node.iChildren[0]].bounds;
+        node.bounds.add(m_Nodes[node.iChildren[1]].bounds);
+    }
+}
+
+bool EntityBVH::rayHitsBox(glm::vec3 origin, glm::vec3 invDir, const Bounds &box, float maxDist) {
+    if (box.isEmpty()) {
+        return false;
+    }
+
+    glm::vec3 t1 = (box.mins - origin) * invDir;
+    glm::vec3 t2 = (box.maxs - origin) * invDir;
+    glm::vec3 tMin = glm::min(t1, t2);
+    glm::vec3 tMax = glm::max(t1, t2);
+
+    float tEnter = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+    float tExit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDist));
+
+    return tEnter <= tExit;
+}
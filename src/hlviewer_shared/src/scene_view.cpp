@@ -103,6 +103,27 @@ SceneView::SceneView(LevelAsset &level)
     m_SceneRenderer.setSkyboxMaterial(m_pSkyboxMaterial.get());
 }
 
+void SceneView::setWorldState(WorldStateBase *ws) {
+    m_pWorldState = ws;
+    m_IsEntMerged.clear();
+
+    std::vector<const Model *> staticModels;
+
+    if (ws) {
+        auto &ents = ws->getEntList();
+        m_IsEntMerged.resize(ents.size(), false);
+
+        for (size_t i = 0; i < ents.size(); i++) {
+            if (ents[i]->isStaticBrush()) {
+                staticModels.push_back(ents[i]->getModel());
+                m_IsEntMerged[i] = true;
+            }
+        }
+    }
+
+    m_SceneRenderer.setStaticBrushModels({staticModels.data(), staticModels.size()});
+}
+
 void SceneView::setSkyTexture(std::string_view skyname) {
     std::string skyPath = "assets:gfx/env/" + std::string(skyname);
     std::unique_ptr<Texture> cubemap;
@@ -128,6 +149,31 @@ void SceneView::showDebugDialog(const char *title, bool *isVisible) {
 }
 
 void SceneView::renderBackBuffer() {
+    setupSceneRendering();
+    renderScene();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SceneView::renderBackBuffers(appfw::span<SceneView *const> views) {
+    // Entity lists upload box instances, fill them on the GL thread
+    std::vector<SceneRenderer *> renderers;
+    renderers.reserve(views.size());
+
+    for (SceneView *pView : views) {
+        pView->setupSceneRendering();
+        renderers.push_back(&pView->m_SceneRenderer);
+    }
+
+    SceneRenderer::prepareScenes({renderers.data(), renderers.size()});
+
+    for (SceneView *pView : views) {
+        pView->renderScene();
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void SceneView::setupSceneRendering() {
     // Scale viewport FOV
     // Assume that v_fov is hor fov at 4:3 aspect ratio
     // Keep vertical fov constant, only scale horizontal
@@ -151,9 +197,10 @@ void SceneView::renderBackBuffer() {
         clearEntities();
         addVisibleEnts();
     }
+}
 
+void SceneView::renderScene() {
     m_SceneRenderer.renderScene(m_Framebuffer.getId(), 0, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 Ray SceneView::viewportPointToRay(const glm::vec2 &pos) {
@@ -228,6 +275,11 @@ void SceneView::addVisibleEnts() {
         }
 
         if (pEnt->getModel()) {
+            if (i < m_IsEntMerged.size() && m_IsEntMerged[i]) {
+                // Drawn by the world renderer
+                continue;
+            }
+
             if (entCount == MAX_VISIBLE_ENTS) {
                 continue;
             }
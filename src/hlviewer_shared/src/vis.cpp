@@ -1,3 +1,4 @@
+#include <app_base/app_base.h>
 #include <renderer/utils.h>
 #include <hlviewer/vis.h>
 #include <hlviewer/world_state_base.h>
@@ -113,7 +114,7 @@ bool Vis::rayIntersectsWithSurface(const Ray &ray, int surfIdx, SurfaceRaycastHi
     glm::vec3 point = ray.origin + ray.direction * d;
 
     // Check if the point is in the face
-    std::vector<glm::vec3> vertices = m_pLevel->getFaceVertices(face);
+    appfw::span<const glm::vec3> vertices = m_pLevel->getFaceVertices(surfIdx);
     size_t count = vertices.size();
 
     for (size_t j = 0; j < count; j++) {
@@ -135,6 +136,12 @@ bool Vis::rayIntersectsWithSurface(const Ray &ray, int surfIdx, SurfaceRaycastHi
 
 bool Vis::raycastToSurface(const Ray &ray, SurfaceRaycastHit &hit, bool ignoreTriggers,
                            float maxDist) {
+    m_EntityBVH.update(m_WorldState.getEntList());
+    return castToSurface(ray, hit, ignoreTriggers, maxDist);
+}
+
+bool Vis::castToSurface(const Ray &ray, SurfaceRaycastHit &hit, bool ignoreTriggers,
+                        float maxDist) {
     hit = SurfaceRaycastHit();
     hit.distance = maxDist;
 
@@ -144,7 +151,7 @@ bool Vis::raycastToSurface(const Ray &ray, SurfaceRaycastHit &hit, bool ignoreTr
     }
 
     // Entities are not rendered behind the world so raycast can't go further than the world
-    if (raycastToEntitySurface(ray, entHit, ignoreTriggers, worldHit.distance)) {
+    if (castToEntitySurface(ray, entHit, ignoreTriggers, worldHit.distance)) {
         hit = entHit;
     }
 
@@ -173,17 +180,51 @@ bool Vis::raycastToWorldSurface(const Ray &ray, SurfaceRaycastHit &hit, float ma
     return hit.surface != -1;
 }
 
-bool Vis::raycastToEntitySurface(const Ray &inputRay, SurfaceRaycastHit &hit, bool ignoreTriggers,
+bool Vis::raycastToEntitySurface(const Ray &ray, SurfaceRaycastHit &hit, bool ignoreTriggers,
                                  float maxDist) {
+    m_EntityBVH.update(m_WorldState.getEntList());
+    return castToEntitySurface(ray, hit, ignoreTriggers, maxDist);
+}
+
+bool Vis::raycastToEntity(const Ray &ray, EntityRaycastHit &hit, bool ignoreTriggers,
+                          float maxDist) {
+    m_EntityBVH.update(m_WorldState.getEntList());
+    return castToEntity(ray, hit, ignoreTriggers, maxDist);
+}
+
+void Vis::raycastToSurfaceBatch(appfw::span<const Ray> rays, appfw::span<SurfaceRaycastHit> hits,
+                                bool ignoreTriggers, float maxDist) {
+    AFW_ASSERT(rays.size() == hits.size());
+    m_EntityBVH.update(m_WorldState.getEntList());
+    runBatch(rays.size(),
+             [&](size_t i) { castToSurface(rays[i], hits[i], ignoreTriggers, maxDist); });
+}
+
+void Vis::raycastToWorldSurfaceBatch(appfw::span<const Ray> rays,
+                                     appfw::span<SurfaceRaycastHit> hits, float maxDist) {
+    AFW_ASSERT(rays.size() == hits.size());
+    runBatch(rays.size(), [&](size_t i) { raycastToWorldSurface(rays[i], hits[i], maxDist); });
+}
+
+void Vis::raycastToEntityBatch(appfw::span<const Ray> rays, appfw::span<EntityRaycastHit> hits,
+                               bool ignoreTriggers, float maxDist) {
+    AFW_ASSERT(rays.size() == hits.size());
+    m_EntityBVH.update(m_WorldState.getEntList());
+    runBatch(rays.size(),
+             [&](size_t i) { castToEntity(rays[i], hits[i], ignoreTriggers, maxDist); });
+}
+
+bool Vis::castToEntitySurface(const Ray &inputRay, SurfaceRaycastHit &hit, bool ignoreTriggers,
+                              float maxDist) {
     hit = SurfaceRaycastHit();
     hit.distance = maxDist;
     auto &ents = m_WorldState.getEntList();
 
-    for (size_t i = 0; i < ents.size(); i++) {
+    auto fnTestEntity = [&](int i) {
         BaseEntity *pEnt = ents[i].get();
 
         if (ignoreTriggers && pEnt->isTrigger()) {
-            continue;
+            return hit.distance;
         }
 
         if (pEnt->getModel() && pEnt->getModel()->type == ModelType::Brush) {
@@ -200,25 +241,28 @@ bool Vis::raycastToEntitySurface(const Ray &inputRay, SurfaceRaycastHit &hit, bo
             if (testHit.surface != -1) {
                 hit = testHit;
                 hit.point += pEnt->getOrigin();
-                hit.entIndex = (int)i;
+                hit.entIndex = i;
             }
         }
-    }
 
+        return hit.distance;
+    };
+
+    m_EntityBVH.raycast(inputRay.origin, inputRay.direction, hit.distance, fnTestEntity);
     return hit.entIndex != -1;
 }
 
-bool Vis::raycastToEntity(const Ray &inputRay, EntityRaycastHit &hit, bool ignoreTriggers,
-                          float maxDist) {
+bool Vis::castToEntity(const Ray &inputRay, EntityRaycastHit &hit, bool ignoreTriggers,
+                       float maxDist) {
     hit = EntityRaycastHit();
     hit.distance = maxDist;
     auto &ents = m_WorldState.getEntList();
 
-    for (size_t i = 0; i < ents.size(); i++) {
+    auto fnTestEntity = [&](int i) {
         BaseEntity *pEnt = ents[i].get();
 
         if (ignoreTriggers && pEnt->isTrigger()) {
-            continue;
+            return hit.distance;
         }
 
         if (pEnt->useAABB()) {
@@ -230,7 +274,7 @@ bool Vis::raycastToEntity(const Ray &inputRay, EntityRaycastHit &hit, bool ignor
                 float dist = glm::length(hitpoint - inputRay.origin);
 
                 if (dist < hit.distance) {
-                    hit.entity = (int)i;
+                    hit.entity = i;
                     hit.point = hitpoint;
                     hit.distance = dist;
                 }
@@ -252,17 +296,39 @@ bool Vis::raycastToEntity(const Ray &inputRay, EntityRaycastHit &hit, bool ignor
                 if (testHit.surface != -1) {
                     hit.point = testHit.point + pEnt->getOrigin();
                     hit.distance = testHit.distance;
-                    hit.entity = (int)i;
+                    hit.entity = i;
                 }
             } else {
                 AFW_ASSERT_MSG(false, "Unknown model type");
             }
         }
-    }
 
+        return hit.distance;
+    };
+
+    m_EntityBVH.raycast(inputRay.origin, inputRay.direction, hit.distance, fnTestEntity);
     return hit.entity != -1;
 }
 
+void Vis::invalidateEntityBounds(int entIdx) {
+    m_EntityBVH.invalidateEntity(entIdx);
+}
+
+template <typename F>
+void Vis::runBatch(size_t count, F fn) {
+    if (count < BATCH_CHUNK_SIZE || !AppBase::isBaseReady()) {
+        for (size_t i = 0; i < count; i++) {
+            fn(i);
+        }
+
+        return;
+    }
+
+    tf::Taskflow taskflow;
+    taskflow.for_each_index_dynamic((size_t)0, count, (size_t)1, fn, BATCH_CHUNK_SIZE);
+    AppBase::getBaseInstance().getExecutor().run(taskflow).wait();
+}
+
 //! Fast Ray-Box Intersection
 //! by Andrew Woo
 //! from "Graphics Gems", Academic Press, 1990
@@ -164,28 +164,13 @@ void WorldStateBase::loadBrushModels() {
 
         // Calculate radius
         float radius = 0;
-        auto &lvlSurfEdges = m_Level.getSurfEdges();
-        auto &lvlVertices = m_Level.getVertices();
 
         for (unsigned faceidx = model.uFirstFace; faceidx < model.uFirstFace + model.uFaceNum; faceidx++) {
-            const bsp::BSPFace &face = m_Level.getFaces().at(faceidx);
-            for (int j = 0; j < face.nEdges; j++) {
-                glm::vec3 vertex;
-                bsp::BSPSurfEdge iEdgeIdx = lvlSurfEdges.at((size_t)face.iFirstEdge + j);
-
-                if (iEdgeIdx > 0) {
-                    const bsp::BSPEdge &edge = m_Level.getEdges().at(iEdgeIdx);
-                    vertex = lvlVertices.at(edge.iVertex[0]);
-                } else {
-                    const bsp::BSPEdge &edge = m_Level.getEdges().at(-iEdgeIdx);
-                    vertex = lvlVertices.at(edge.iVertex[1]);
-                }
-
+            for (glm::vec3 vertex : m_Level.getFaceVertices(faceidx)) {
                 radius = std::max(radius, std::abs(vertex.x));
                 radius = std::max(radius, std::abs(vertex.y));
                 radius = std::max(radius, std::abs(vertex.z));
             }
-
         }
 
         model.flRadius = radius;
@@ -3,6 +3,7 @@
 #include <appfw/appfw.h>
 #include <glm/glm.hpp>
 #include <app_base/app_config.h>
+#include <app_base/lightmap.h>
 #include <app_base/yaml.h>
 
 namespace rad {
@@ -63,6 +64,10 @@ struct BuildProfile {
     int iOversample = -1;
     //! Sample neighbour faces
     bool bSampleNeighbours = false;
+    //! Format of luxels in the lightmap file
+    LightmapFileFormat::Format lightmapFormat = LightmapFileFormat::Format::Unknown;
+    //! Compression of the lightmap texture data
+    LightmapFileFormat::Compression lightmapCompression = LightmapFileFormat::Compression::None;
 
     //! Number of light bounce passes.
     int iBounceCount = -1;
@@ -85,6 +85,33 @@ void rad::BuildProfile::loadProfile(const YAML::Node &node) {
         bSampleNeighbours = node["sample_neighbours"].as<bool>();
     }
 
+    if (node["lightmap_format"]) {
+        std::string format = node["lightmap_format"].as<std::string>();
+
+        if (format == "rgbf32") {
+            lightmapFormat = LightmapFileFormat::Format::RGBF32;
+        } else if (format == "rgb16f") {
+            lightmapFormat = LightmapFileFormat::Format::RGB16F;
+        } else if (format == "rgb9e5") {
+            lightmapFormat = LightmapFileFormat::Format::RGB9E5;
+        } else {
+            throw std::runtime_error(fmt::format("Profile: invalid lightmap_format {}", format));
+        }
+    }
+
+    if (node["lightmap_compression"]) {
+        std::string compression = node["lightmap_compression"].as<std::string>();
+
+        if (compression == "none") {
+            lightmapCompression = LightmapFileFormat::Compression::None;
+        } else if (compression == "lz") {
+            lightmapCompression = LightmapFileFormat::Compression::LZ;
+        } else {
+            throw std::runtime_error(
+                fmt::format("Profile: invalid lightmap_compression {}", compression));
+        }
+    }
+
     if (node["bounce_count"]) {
         iBounceCount = node["bounce_count"].as<int>();
     }
@@ -115,6 +142,10 @@ void rad::BuildProfile::finalize() {
         throw std::runtime_error("Profile: oversample not set. Check _common profile.");
     }
 
+    if (lightmapFormat == LightmapFileFormat::Format::Unknown) {
+        throw std::runtime_error("Profile: lightmap_format not set. Check _common profile.");
+    }
+
     if (iBounceCount == -1) {
         throw std::runtime_error("Profile: bounce_count not set. Check _common profile.");
     }
@@ -1,6 +1,8 @@
 #include <stb_rect_pack.h>
+#include <glm/gtc/packing.hpp>
 #include <appfw/timer.h>
 #include <app_base/lightmap.h>
+#include <app_base/lz_block.h>
 #include "lightmap_writer.h"
 #include "filters.h"
 
@@ -77,6 +79,17 @@ void rad::LightmapWriter::sampleLightmap(FaceLightmap &lm, size_t faceIdx, float
     bool bSampleNeighbours = m_RadSim.m_Profile.bSampleNeighbours;
     const Face &face = m_RadSim.m_Faces[faceIdx];
 
+    // Filter options
+    float maxPixelSize = std::max(face.flPatchSize, luxelSize);
+    float filterk = 1.0f / maxPixelSize;
+    float radius = FILTER_RADIUS * maxPixelSize;
+
+    m_Neighbours.clear();
+
+    if (bSampleNeighbours) {
+        findNeighbours(lm, faceIdx, luxelSize, radius);
+    }
+
     for (int lmy = 0; lmy < lmSize.y; lmy++) {
         glm::vec3 *lmrow[bsp::NUM_LIGHTSTYLES];
 
@@ -92,50 +105,16 @@ void rad::LightmapWriter::sampleLightmap(FaceLightmap &lm, size_t faceIdx, float
             std::fill(std::begin(output), std::end(output), glm::vec3(0, 0, 0));
             float weightSum = 0;
 
-            // Filter options
-            float maxPixelSize = std::max(face.flPatchSize, luxelSize);
-            float filterk = 1.0f / maxPixelSize;
-            float radius = FILTER_RADIUS * maxPixelSize;
-
             // Sample from face
-            sampleFace(face, luxelPos, radius, glm::vec2(filterk), output, weightSum, false);
+            sampleFace(face, luxelPos, radius, glm::vec2(filterk), output, weightSum);
 
-            if (bSampleNeighbours) {
+            if (!m_Neighbours.empty()) {
                 // Sample from neighbours
-                int normalDir = !!face.nPlaneSide;
-                auto &neighbours = m_RadSim.m_Planes[face.iPlane].faces;
                 glm::vec3 luxelWorldPos = face.faceToWorld(luxelPos);
 
-                for (unsigned neighbourIdx : neighbours) {
-                    Face &neighbour = m_RadSim.m_Faces[neighbourIdx];
-
-                    if (neighbourIdx == faceIdx || !neighbour.hasLightmap()) {
-                        continue;
-                    }
-
-                    if (normalDir != !!neighbour.nPlaneSide) {
-                        // Wrong side
-                        continue;
-                    }
-
-                    if (!isNullVector(neighbour.vLightColor)) {
-                        // Ignore texlights, they have insane color values
-                        continue;
-                    }
-
-                    glm::vec3 neighbourSamples[4] = {};
-                    glm::vec2 luxelPosHere = neighbour.worldToFace(luxelWorldPos);
-                    sampleFace(neighbour, luxelPosHere, radius, glm::vec2(filterk),
-                               neighbourSamples, weightSum, true);
-
-                    // Adjust lightstyles
-                    for (int i = 0; i < 4; i++) {
-                        int idx = neighbour.findLightstyle(face.nStyles[i]);
-
-                        if (idx != -1) {
-                            output[i] += neighbourSamples[idx];
-                        }
-                    }
+                for (const NeighbourFace &nb : m_Neighbours) {
+                    sampleNeighbour(nb, luxelWorldPos, radius, glm::vec2(filterk), output,
+                                    weightSum);
                 }
             }
 
@@ -165,10 +144,8 @@ void rad::LightmapWriter::sampleLightmap(FaceLightmap &lm, size_t faceIdx, float
 //! @param  filterk     Filter coefficient
 //! @param  out         Output sum of colors
 //! @prarm  weightSum   Sum of weights
-//! @param  checkTrace  Whether to check if there is visibility from luxelPos to sampled patch
 void rad::LightmapWriter::sampleFace(const Face &face, glm::vec2 luxelPos, float radius,
-                                     glm::vec2 filterk, glm::vec3 out[4], float &weightSum,
-                                     bool checkTrace) {
+                                     glm::vec2 filterk, glm::vec3 out[4], float &weightSum) {
     // Check if pos intersects with the face
     glm::vec2 corners[4];
     getCorners(luxelPos, radius * 2.0f, corners);
@@ -180,17 +157,13 @@ void rad::LightmapWriter::sampleFace(const Face &face, glm::vec2 luxelPos, float
     }
 
     PatchIndex count = face.iNumPatches;
-    glm::vec3 tracePos = face.faceToWorld(luxelPos) + face.vNormal * TRACE_OFFSET;
-    // TODO: tracePos should be clamped to face's edge
 
     for (PatchIndex i = 0; i < count; i++) {
         PatchRef patch(m_RadSim.m_Patches, face.iFirstPatch + i);
 
         glm::vec2 d = patch.getFaceOrigin() - luxelPos;
-        glm::vec3 patchTracePos = patch.getOrigin() + patch.getNormal() * TRACE_OFFSET;
 
-        if (std::abs(d.x) <= radius && std::abs(d.y) <= radius &&
-            (!checkTrace || m_RadSim.traceLine(tracePos, patchTracePos) == bsp::CONTENTS_EMPTY)) {
+        if (std::abs(d.x) <= radius && std::abs(d.y) <= radius) {
             float weight = lightmapFilter(d.x * filterk.x) * lightmapFilter(d.y * filterk.y);
 #if 1
             // Sample final color
@@ -207,12 +180,164 @@ void rad::LightmapWriter::sampleFace(const Face &face, glm::vec2 luxelPos, float
     }
 }
 
+//! @param  nb              The neighbour face
+//! @param  luxelWorldPos   Position of the center in world coords
+//! @param  radius          Half-size of the square
+//! @param  filterk         Filter coefficient
+//! @param  out             Output sum of colors, in lightstyles of the sampling face
+//! @prarm  weightSum       Sum of weights
+void rad::LightmapWriter::sampleNeighbour(const NeighbourFace &nb, glm::vec3 luxelWorldPos,
+                                          float radius, glm::vec2 filterk, glm::vec3 out[4],
+                                          float &weightSum) {
+    glm::vec2 luxelPos = nb.pFace->worldToFace(luxelWorldPos);
+
+    for (PatchIndex i : nb.patches) {
+        PatchRef patch(m_RadSim.m_Patches, i);
+        glm::vec2 d = patch.getFaceOrigin() - luxelPos;
+
+        if (std::abs(d.x) <= radius && std::abs(d.y) <= radius) {
+            float weight = lightmapFilter(d.x * filterk.x) * lightmapFilter(d.y * filterk.y);
+            const PatchFinalColor &color = patch.getFinalColor();
+
+            // Adjust lightstyles
+            for (int j = 0; j < bsp::NUM_LIGHTSTYLES; j++) {
+                if (nb.iStyleMap[j] != -1) {
+                    out[j] += weight * color.color[nb.iStyleMap[j]];
+                }
+            }
+
+            weightSum += weight;
+        }
+    }
+}
+
+void rad::LightmapWriter::findNeighbours(const FaceLightmap &lm, size_t faceIdx, float luxelSize,
+                                         float radius) {
+    const Face &face = m_RadSim.m_Faces[faceIdx];
+    int normalDir = !!face.nPlaneSide;
+
+    // Luxel centers can only sample patches in this rect (in face coords).
+    // Neighbours use different axes in the same plane so the square filter window can be rotated.
+    float reach = radius * std::sqrt(2.0f);
+    glm::vec2 reachMins = lm.vFaceOffset - glm::vec2(reach);
+    glm::vec2 reachMaxs = lm.vFaceOffset + glm::vec2(lm.vSize) * luxelSize + glm::vec2(reach);
+
+    for (unsigned neighbourIdx : m_RadSim.m_Planes[face.iPlane].faces) {
+        const Face &neighbour = m_RadSim.m_Faces[neighbourIdx];
+
+        if (neighbourIdx == faceIdx || !neighbour.hasLightmap()) {
+            continue;
+        }
+
+        if (normalDir != !!neighbour.nPlaneSide) {
+            // Wrong side
+            continue;
+        }
+
+        if (!isNullVector(neighbour.vLightColor)) {
+            // Ignore texlights, they have insane color values
+            continue;
+        }
+
+        // Check that the neighbour shares an edge or is within the filter radius
+        glm::vec2 nbMins = glm::vec2(std::numeric_limits<float>::max());
+        glm::vec2 nbMaxs = glm::vec2(std::numeric_limits<float>::lowest());
+
+        for (const Face::Vertex &v : neighbour.vertices) {
+            glm::vec2 pos = face.worldToFace(v.vWorldPos);
+            nbMins = glm::min(nbMins, pos);
+            nbMaxs = glm::max(nbMaxs, pos);
+        }
+
+        glm::vec2 reachAABB[] = {reachMins, reachMaxs};
+        glm::vec2 nbAABB[] = {nbMins, nbMaxs};
+
+        if (!intersectAABB(reachAABB, nbAABB)) {
+            continue;
+        }
+
+        NeighbourFace nb;
+        nb.pFace = &neighbour;
+
+        for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
+            nb.iStyleMap[i] = neighbour.findLightstyle(face.nStyles[i]);
+        }
+
+        // Find reachable patches.
+        // Trace is done once per patch from the closest point of the face instead of every luxel.
+        for (PatchIndex i = neighbour.iFirstPatch;
+             i < neighbour.iFirstPatch + neighbour.iNumPatches; i++) {
+            PatchRef patch(m_RadSim.m_Patches, i);
+            glm::vec2 patchPos = face.worldToFace(patch.getOrigin());
+
+            if (patchPos.x < reachMins.x || patchPos.y < reachMins.y ||
+                patchPos.x > reachMaxs.x || patchPos.y > reachMaxs.y) {
+                continue;
+            }
+
+            // Move the point a bit inside the face so it doesn't touch walls on the edges
+            glm::vec2 tracePos2D = getClosestPointOnFace(face, patchPos);
+            glm::vec2 toCenter = face.vFaceCenter - tracePos2D;
+
+            if (glm::length(toCenter) > TRACE_OFFSET) {
+                tracePos2D += glm::normalize(toCenter) * TRACE_OFFSET;
+            }
+
+            glm::vec3 tracePos = face.faceToWorld(tracePos2D) + face.vNormal * TRACE_OFFSET;
+            glm::vec3 patchTracePos = patch.getOrigin() + patch.getNormal() * TRACE_OFFSET;
+
+            if (m_RadSim.traceLine(tracePos, patchTracePos) == bsp::CONTENTS_EMPTY) {
+                nb.patches.push_back(i);
+            }
+        }
+
+        if (!nb.patches.empty()) {
+            m_Neighbours.push_back(std::move(nb));
+        }
+    }
+}
+
+glm::vec2 rad::LightmapWriter::getClosestPointOnFace(const Face &face, glm::vec2 point) {
+    size_t count = face.vertices.size();
+    glm::vec2 closest = point;
+    float closestDist = std::numeric_limits<float>::max();
+    bool isInside = true;
+
+    for (size_t i = 0; i < count; i++) {
+        glm::vec2 a = face.vertices[i].vFacePos;
+        glm::vec2 b = face.vertices[(i + 1) % count].vFacePos;
+        glm::vec2 edge = b - a;
+        glm::vec2 p = point - a;
+        float edgeLen2 = glm::dot(edge, edge);
+
+        if (edgeLen2 == 0) {
+            continue;
+        }
+
+        // Same test as in PatchDivider::isInFace. vFaceI x vFaceJ = -vNormal.
+        if (edge.x * p.y - edge.y * p.x < 0) {
+            isInside = false;
+        }
+
+        float t = std::clamp(glm::dot(p, edge) / edgeLen2, 0.0f, 1.0f);
+        glm::vec2 pointOnEdge = a + edge * t;
+        float dist = glm::length(point - pointOnEdge);
+
+        if (dist < closestDist) {
+            closestDist = dist;
+            closest = pointOnEdge;
+        }
+    }
+
+    return isInside ? point : closest;
+}
+
 void rad::LightmapWriter::createBlock() {
     printn("Allocating lightmap block...");
     appfw::Timer timer;
 
     std::vector<stbrp_rect> rects(m_Lightmaps.size());
-    int totalLightmapArea = 0;
+    int64_t totalLightmapArea = 0;
 
     for (int i = 0; i < m_Lightmaps.size(); i++) {
         FaceLightmap &lm = m_Lightmaps[i];
@@ -224,50 +349,123 @@ void rad::LightmapWriter::createBlock() {
         totalLightmapArea += rect.w * rect.h;
     }
 
-    // Estimate texture size
-    int squareSize = (int)ceil(totalLightmapArea / (1 - LIGHTMAP_BLOCK_WASTED));
-    int textureSize = std::min((int)sqrt(squareSize), m_iMaxBlockSize);
+    auto fnRoundSize = [&](int size) {
+        if (size % 4 != 0) {
+            size += (4 - size % 4); // round up so it's divisable by 4
+        }
 
-    if (textureSize % 4 != 0) {
-        textureSize += (4 - textureSize % 4); // round up so it's divisable by 4
+        return std::clamp(size, 4, m_iMaxBlockSize);
+    };
+
+    // Estimate page size from the total area. If everything doesn't fit into one page, it is
+    // grown until it does or until block_size is reached. Only then extra pages are added.
+    int64_t squareSize = (int64_t)ceil(totalLightmapArea / (1 - LIGHTMAP_BLOCK_WASTED));
+    int pageSize = fnRoundSize((int)std::min<int64_t>((int64_t)sqrt(squareSize), m_iMaxBlockSize));
+    std::vector<int> rectPages;
+    int pageCount = 0;
+
+    for (;;) {
+        pageCount = packPages(pageSize, rects, rectPages);
+
+        if (pageCount <= 1 || pageSize >= m_iMaxBlockSize) {
+            break;
+        }
+
+        pageSize = fnRoundSize(pageSize + pageSize / 4);
     }
 
-    m_iBlockSize = textureSize;
+    m_iBlockSize = pageSize;
 
-    // Pack lightmaps
-    stbrp_context packContext;
-    std::vector<stbrp_node> packNodes(2 * textureSize);
-    stbrp_init_target(&packContext, textureSize, textureSize, packNodes.data(),
-                      (int)packNodes.size());
+    // Find populated lightstyle layers
+    m_uLayerMask = 0;
 
-    stbrp_pack_rects(&packContext, rects.data(), (int)rects.size());
+    for (const Face &face : m_RadSim.m_Faces) {
+        if (face.hasLightmap()) {
+            m_uLayerMask |= getFaceStyleMask(face);
+        }
+    }
 
     // Create bitmaps
-    for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
-        m_Bitmaps[i].init(textureSize, textureSize);
+    m_Pages.clear();
+    m_Pages.resize(pageCount);
+
+    for (LightmapPage &page : m_Pages) {
+        for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
+            if (m_uLayerMask & (1 << i)) {
+                page.bitmaps[i].init(pageSize, pageSize);
+            }
+        }
     }
 
     // Add lightmaps to bitmaps
+    int64_t usedArea = 0;
+
     for (const stbrp_rect &rect : rects) {
         FaceLightmap &lm = m_Lightmaps[rect.id];
+        LightmapPage &page = m_Pages[rectPages[rect.id]];
 
-        if (rect.was_packed) {
-            for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
-                m_Bitmaps[i].copyPixels(rect.x, rect.y, lm.vSize.x, lm.vSize.y,
-                                        lm.lightmapData[i].data(), m_iBlockPadding);
+        for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
+            if (!(m_uLayerMask & (1 << i))) {
+                continue;
             }
 
-            lm.vBlockOffset.x = rect.x + m_iBlockPadding;
-            lm.vBlockOffset.y = rect.y + m_iBlockPadding;
-        } else {
+            page.bitmaps[i].copyPixels(rect.x, rect.y, lm.vSize.x, lm.vSize.y,
+                                       lm.lightmapData[i].data(), m_iBlockPadding);
+        }
+
+        lm.iPage = rectPages[rect.id];
+        lm.vBlockOffset.x = rect.x + m_iBlockPadding;
+        lm.vBlockOffset.y = rect.y + m_iBlockPadding;
+        usedArea += rect.w * rect.h;
+    }
+
+    printi("Lightmap block: {} page(s) of {}x{}, {:.1f}% filled", pageCount, pageSize, pageSize,
+           100.0 * usedArea / ((int64_t)pageCount * pageSize * pageSize));
+    printi("Allocate lightmap block: {:.3} s", timer.dseconds());
+}
+
+int rad::LightmapWriter::packPages(int pageSize, std::vector<stbrp_rect> &rects,
+                                   std::vector<int> &rectPages) {
+    // stb_rect_pack sorts rects by height, then by width (area for equal heights)
+    std::vector<stbrp_rect> remaining = rects;
+    std::vector<stbrp_rect> notPacked;
+    std::vector<stbrp_node> packNodes(2 * pageSize);
+    rectPages.assign(rects.size(), -1);
+    int pageCount = 0;
+
+    while (!remaining.empty()) {
+        stbrp_context packContext;
+        stbrp_init_target(&packContext, pageSize, pageSize, packNodes.data(),
+                          (int)packNodes.size());
+        stbrp_setup_heuristic(&packContext, STBRP_HEURISTIC_Skyline_BF_sortHeight);
+        stbrp_pack_rects(&packContext, remaining.data(), (int)remaining.size());
+
+        notPacked.clear();
+
+        for (const stbrp_rect &rect : remaining) {
+            if (rect.was_packed) {
+                rects[rect.id] = rect;
+                rectPages[rect.id] = pageCount;
+            } else {
+                notPacked.push_back(rect);
+            }
+        }
+
+        if (notPacked.size() == remaining.size()) {
+            // Nothing fits into an empty page
+            const stbrp_rect &rect = notPacked.front();
+            const FaceLightmap &lm = m_Lightmaps[rect.id];
             throw std::runtime_error(
                 fmt::format("Failed to add lightmap {}/{} ({}x{}) to the texture "
                             "block. Please, resize the texture block.",
                             rect.id + 1, m_Lightmaps.size(), lm.vSize.x, lm.vSize.y));
         }
+
+        std::swap(remaining, notPacked);
+        pageCount++;
     }
 
-    printi("Allocate lightmap block: {:.3} s", timer.dseconds());
+    return pageCount;
 }
 
 void rad::LightmapWriter::writeLightmapFile() {
@@ -277,6 +475,8 @@ void rad::LightmapWriter::writeLightmapFile() {
     fs::path lmPath = getFileSystem().getFilePath(m_RadSim.getLightmapPath());
     appfw::BinaryOutputFile file(lmPath);
     size_t faceCount = m_RadSim.m_Faces.size();
+    LightmapFileFormat::Format format = m_RadSim.m_Profile.lightmapFormat;
+    LightmapFileFormat::Compression compression = m_RadSim.m_Profile.lightmapCompression;
 
     // Header
     file.writeBytes(LightmapFileFormat::MAGIC, sizeof(LightmapFileFormat::MAGIC));
@@ -284,14 +484,22 @@ void rad::LightmapWriter::writeLightmapFile() {
     file.writeUInt32((uint32_t)m_Lightmaps.size());                 // Lightmap count
     file.writeInt32(m_iBlockSize);                                  // Lightmap texture wide
     file.writeInt32(m_iBlockSize);                                  // Lightmap texture tall
-    file.writeByte((uint8_t)LightmapFileFormat::Format::RGBF32);    // Lightmap data format
-    file.writeByte((uint8_t)LightmapFileFormat::Compression::None); // Lightmap compression
+    file.writeUInt32((uint32_t)m_Pages.size());                     // Lightmap page count
+    file.writeByte((uint8_t)format);                                // Lightmap data format
+    file.writeByte((uint8_t)compression);                           // Lightmap compression
+    file.writeByte(m_uLayerMask);                                   // Populated lightstyle layers
 
     // Lightmap texture block
-    size_t texBlockDataSize = sizeof(glm::vec3) * m_iBlockSize * m_iBlockSize;
-    for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
-        file.writeBytes(reinterpret_cast<const uint8_t *>(m_Bitmaps[i].getPixels().data()),
-                        texBlockDataSize);
+    std::vector<uint8_t> texData = encodeLightmapTexture(format);
+
+    if (compression == LightmapFileFormat::Compression::LZ) {
+        std::vector<uint8_t> compressed = lz::compress(texData.data(), texData.size());
+        file.writeUInt32((uint32_t)compressed.size()); // Compressed size
+        file.writeBytes(compressed.data(), compressed.size());
+        printi("Lightmap texture: {:.2f} MiB -> {:.2f} MiB", texData.size() / 1024.0 / 1024.0,
+               compressed.size() / 1024.0 / 1024.0);
+    } else {
+        file.writeBytes(texData.data(), texData.size());
     }
 
     // Face info
@@ -309,12 +517,14 @@ void rad::LightmapWriter::writeLightmapFile() {
         for (int j = 0; j < bsp::NUM_LIGHTSTYLES; j++) {
             file.writeByte(face.nStyles[j]);
         }
+        file.writeByte(getFaceStyleMask(face)); // Lightstyle presence bits
 
         if (face.hasLightmap()) {
             const FaceLightmap &lm = m_Lightmaps[m_LightmapIdx[i]];
 
             file.writeByte(1);       // Has lightmap
-            file.writeVec(lm.vSize); // Lightmap size
+            file.writeVec(lm.vSize);              // Lightmap size
+            file.writeUInt32((uint32_t)lm.iPage); // Lightmap page
 
             // Lightmap tex coords
             for (size_t j = 0; j < vertCount; j++) {
@@ -337,6 +547,64 @@ void rad::LightmapWriter::writeLightmapFile() {
     printi("Write lightmap file: {:.3} s", timer.dseconds());
 }
 
+std::vector<uint8_t> rad::LightmapWriter::encodeLightmapTexture(LightmapFileFormat::Format format) {
+    size_t luxelSize = LightmapFileFormat::getLuxelSize(format);
+    size_t layerLuxels = (size_t)m_iBlockSize * m_iBlockSize;
+    std::vector<uint8_t> data;
+    data.reserve(luxelSize * layerLuxels * bsp::NUM_LIGHTSTYLES * m_Pages.size());
+
+    for (size_t i = 0; i < m_Pages.size() * bsp::NUM_LIGHTSTYLES; i++) {
+        size_t style = i % bsp::NUM_LIGHTSTYLES;
+
+        if (!(m_uLayerMask & (1 << style))) {
+            // Layer is not stored
+            continue;
+        }
+
+        const glm::vec3 *pixels =
+            m_Pages[i / bsp::NUM_LIGHTSTYLES].bitmaps[style].getPixels().data();
+        data.resize(data.size() + luxelSize * layerLuxels);
+        uint8_t *layer = data.data() + data.size() - luxelSize * layerLuxels;
+
+        switch (format) {
+        case LightmapFileFormat::Format::RGBF32: {
+            memcpy(layer, pixels, luxelSize * layerLuxels);
+            break;
+        }
+        case LightmapFileFormat::Format::RGB16F: {
+            for (size_t j = 0; j < layerLuxels; j++) {
+                glm::u16vec3 half = glm::packHalf(pixels[j]);
+                memcpy(layer + j * luxelSize, &half, luxelSize);
+            }
+            break;
+        }
+        case LightmapFileFormat::Format::RGB9E5: {
+            for (size_t j = 0; j < layerLuxels; j++) {
+                uint32_t packed = glm::packF3x9_E1x5(pixels[j]);
+                memcpy(layer + j * luxelSize, &packed, luxelSize);
+            }
+            break;
+        }
+        default:
+            AFW_ASSERT_REL(false);
+        }
+    }
+
+    return data;
+}
+
+uint8_t rad::LightmapWriter::getFaceStyleMask(const Face &face) {
+    uint8_t mask = 0;
+
+    for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
+        if (face.nStyles[i] != 255) {
+            mask |= 1 << i;
+        }
+    }
+
+    return mask;
+}
+
 void rad::LightmapWriter::getCorners(glm::vec2 point, float size, glm::vec2 corners[4]) {
     size = size / 2.0f;
     corners[0] = point + glm::vec2(-size, -size);
@@ -3,6 +3,8 @@
 #include <appfw/appfw.h>
 #include <appfw/binary_file.h>
 #include <app_base/bitmap.h>
+#include <app_base/lightmap.h>
+#include <stb_rect_pack.h>
 #include "types.h"
 
 namespace rad {
@@ -27,28 +29,68 @@ private:
         std::vector<glm::vec2> vTexCoords;
         std::vector<glm::vec3> lightmapData[bsp::NUM_LIGHTSTYLES];
         glm::ivec2 vBlockOffset;
+        int iPage = 0; //!< Index of the atlas page
         glm::vec2 vFaceOffset; //< Face plane pos of lightmap (0;0)
     };
 
+    //! A face on the same plane that luxels of the face can sample from.
+    struct NeighbourFace {
+        const Face *pFace = nullptr;
+
+        //! Index of neighbour's lightstyle for each lightstyle of the face or -1.
+        int iStyleMap[bsp::NUM_LIGHTSTYLES];
+
+        //! Patches of the neighbour that are in the filter radius and reachable from the face.
+        std::vector<PatchIndex> patches;
+    };
+
+    //! A page of the lightmap atlas. All pages have the same size.
+    struct LightmapPage {
+        Bitmap<glm::vec3> bitmaps[bsp::NUM_LIGHTSTYLES];
+    };
+
     RadSimImpl &m_RadSim;
-    Bitmap<glm::vec3> m_Bitmaps[bsp::NUM_LIGHTSTYLES];
+    std::vector<LightmapPage> m_Pages;
 
     float m_flLuxelSize = 0;
     int m_iOversampleSize = 0;
     int m_iMaxBlockSize = 0;
-    int m_iBlockSize = 0;
+    int m_iBlockSize = 0; //!< Size of a page
     int m_iBlockPadding = 0;
+    uint8_t m_uLayerMask = 0; //!< Bit i is set if any face uses lightstyle slot i
 
     std::vector<size_t> m_LightmapIdx;
     std::vector<FaceLightmap> m_Lightmaps;
+    std::vector<NeighbourFace> m_Neighbours; //!< Neighbours of the face being sampled
 
     void processFace(size_t faceIdx);
     void sampleLightmap(FaceLightmap &lm, size_t faceIdx, float luxelSize);
     void sampleFace(const Face &face, glm::vec2 luxelPos, float radius, glm::vec2 filterk,
-                    glm::vec3 out[4], float &weightSum, bool checkTrace);
+                    glm::vec3 out[4], float &weightSum);
+    void sampleNeighbour(const NeighbourFace &nb, glm::vec3 luxelWorldPos, float radius,
+                         glm::vec2 filterk, glm::vec3 out[4], float &weightSum);
+
+    //! Fills m_Neighbours with faces on the same plane that are close enough to be sampled.
+    void findNeighbours(const FaceLightmap &lm, size_t faceIdx, float luxelSize, float radius);
+
+    //! @returns the point of the face polygon closest to the point. Both are in face coords.
+    static glm::vec2 getClosestPointOnFace(const Face &face, glm::vec2 point);
     void createBlock();
+
+    //! Packs rects into as many pages of pageSize as needed. Throws if a rect doesn't fit a page.
+    //! Tall rects are placed first, rects of the same height are placed from widest.
+    //! @param  rects       Rects indexed by id, receive their positions
+    //! @param  rectPages   Receives page index of each rect id
+    //! @returns number of pages
+    int packPages(int pageSize, std::vector<stbrp_rect> &rects, std::vector<int> &rectPages);
     void writeLightmapFile();
 
+    //! Converts populated lightstyle layers of the block into the luxel format.
+    std::vector<uint8_t> encodeLightmapTexture(LightmapFileFormat::Format format);
+
+    //! @returns bit mask of lightstyle slots used by the face.
+    static uint8_t getFaceStyleMask(const Face &face);
+
     static void getCorners(glm::vec2 point, float size, glm::vec2 corners[4]);
     static bool intersectAABB(const glm::vec2 b1[2], const glm::vec2 b2[2]);
 };
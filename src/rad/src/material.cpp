@@ -1,14 +1,10 @@
 #include "material.h"
-#include "filters.h"
 
 namespace {
 
+//! Sampled rectangle size relative to filter scale.
 constexpr float TEXTURE_FILTER_WIDTH = 1;
 
-float textureFilter(float x) {
-    return rad::filters::linear1(x);
-}
-
 }
 
 void rad::Material::loadProps(MaterialPropLoader &loader, std::string_view texName,
@@ -34,6 +30,8 @@ void rad::Material::loadFromRGB(RadSimImpl &radSim, int wide, int tall, const ui
             m_Pixels[wide * i + j] = radSim.gammaToLinear(fpx);
         }
     }
+
+    buildSummedAreaTable();
 }
 
 void rad::Material::loadFromRGBA(RadSimImpl &radSim, int wide, int tall, const uint8_t *data) {
@@ -54,6 +52,8 @@ void rad::Material::loadFromRGBA(RadSimImpl &radSim, int wide, int tall, const u
             m_Pixels[wide * i + j] = radSim.gammaToLinear(fpx);
         }
     }
+
+    buildSummedAreaTable();
 }
 
 void rad::Material::loadFromWad(RadSimImpl &radSim, const bsp::WADTexture &wadTex) {
@@ -69,29 +69,55 @@ void rad::Material::loadFromWad(RadSimImpl &radSim, const bsp::WADTexture &wadTe
 }
 
 glm::vec3 rad::Material::sampleColor(glm::vec2 pos, glm::vec2 scale) {
-    glm::vec2 filterWidth = scale * TEXTURE_FILTER_WIDTH;
-    int xfrom = (int)std::floor(pos.x - filterWidth.x) - 1;
-    int xto = (int)std::ceil(pos.x + filterWidth.x) + 1;
-    int yfrom = (int)std::floor(pos.y - filterWidth.y) - 1;
-    int yto = (int)std::ceil(pos.y + filterWidth.y) + 1;
-
-    glm::vec3 colorSum = glm::vec3(0, 0, 0);
-    float weightSum = 0;
-    glm::vec2 filterk = 1.0f / scale;
-
-    for (int i = yfrom; i < yto; i++) {
-        for (int j = xfrom; j < xto; j++) {
-            glm::vec3 pixel = readColor(j, i);
-            glm::vec2 curPos = glm::vec2(j, i) + glm::vec2(0.5f, 0.5f);
-            glm::vec2 delta = curPos - pos;
-            float filterx = textureFilter(delta.x * filterk.x);
-            float filtery = textureFilter(delta.y * filterk.y);
-            float weight = filterx * filtery;
-
-            colorSum += pixel * weight;
-            weightSum += weight;
+    glm::dvec2 halfSize = glm::dvec2(scale) * (TEXTURE_FILTER_WIDTH / 2.0);
+    glm::dvec2 from = glm::dvec2(pos) - halfSize;
+    glm::dvec2 to = glm::dvec2(pos) + halfSize;
+
+    glm::dvec3 colorSum = integrateColor(to.x, to.y) - integrateColor(from.x, to.y) -
+                          integrateColor(to.x, from.y) + integrateColor(from.x, from.y);
+    double area = (to.x - from.x) * (to.y - from.y);
+
+    return glm::vec3(colorSum / area);
+}
+
+void rad::Material::buildSummedAreaTable() {
+    int satWide = m_iWide + 1;
+    m_SummedArea.assign((size_t)satWide * (m_iTall + 1), glm::dvec3(0, 0, 0));
+
+    for (int y = 0; y < m_iTall; y++) {
+        glm::dvec3 rowSum = glm::dvec3(0, 0, 0);
+
+        for (int x = 0; x < m_iWide; x++) {
+            rowSum += glm::dvec3(m_Pixels[(size_t)m_iWide * y + x]);
+            m_SummedArea[(size_t)satWide * (y + 1) + (x + 1)] =
+                m_SummedArea[(size_t)satWide * y + (x + 1)] + rowSum;
         }
     }
+}
+
+glm::dvec3 rad::Material::integrateColor(double x, double y) {
+    // Split into whole texture repeats and the remainder
+    double qx = std::floor(x / m_iWide);
+    double qy = std::floor(y / m_iTall);
+    double rx = x - qx * m_iWide;
+    double ry = y - qy * m_iTall;
+
+    return qx * qy * integrateColorInTexture(m_iWide, m_iTall) +
+           qx * integrateColorInTexture(m_iWide, ry) + qy * integrateColorInTexture(rx, m_iTall) +
+           integrateColorInTexture(rx, ry);
+}
 
-    return colorSum / weightSum;
+glm::dvec3 rad::Material::integrateColorInTexture(double x, double y) {
+    // The integral is bilinear inside of a pixel so interpolating the table is exact
+    int satWide = m_iWide + 1;
+    int ix = std::clamp((int)x, 0, m_iWide - 1);
+    int iy = std::clamp((int)y, 0, m_iTall - 1);
+    double fx = x - ix;
+    double fy = y - iy;
+
+    const glm::dvec3 *row0 = m_SummedArea.data() + (size_t)satWide * iy;
+    const glm::dvec3 *row1 = row0 + satWide;
+    glm::dvec3 top = glm::mix(row0[ix], row0[ix + 1], fx);
+    glm::dvec3 bottom = glm::mix(row1[ix], row1[ix + 1], fx);
+    return glm::mix(top, bottom, fy);
 }
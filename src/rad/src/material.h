@@ -37,7 +37,7 @@ public:
     //! @returns whether color can be sampled
     inline bool hasColorTexture() { return !m_Pixels.empty(); }
 
-    //! Samples color around a point.
+    //! Samples average color of a rectangle around a point. Takes constant time.
     //! @param  pos     Sample position
     //! @param  scale   Filter scale in pixels. This should be pixel width of the largest pixel.
     glm::vec3 sampleColor(glm::vec2 pos, glm::vec2 scale);
@@ -56,6 +56,19 @@ private:
     int m_iWide = 0;
     int m_iTall = 0;
     std::vector<glm::vec3> m_Pixels;
+
+    //! Summed-area table, (wide + 1) x (tall + 1).
+    //! Element (x, y) is the sum of pixels in [0, x) x [0, y).
+    std::vector<glm::dvec3> m_SummedArea;
+
+    //! Builds the summed-area table from pixels.
+    void buildSummedAreaTable();
+
+    //! @returns integral of the color over [0, x] x [0, y]. Texture is repeated infinitely.
+    glm::dvec3 integrateColor(double x, double y);
+
+    //! @returns integral of the color over [0, x] x [0, y] for x in [0, wide], y in [0, tall].
+    glm::dvec3 integrateColorInTexture(double x, double y);
 };
 
 } // namespace rad
@@ -1,15 +1,90 @@
 #include "patch_divider.h"
+#include "rad_sim_impl.h"
 
-rad::PatchDivider::~PatchDivider() {
-    while (m_pPatches) {
-        MiniPatch *p = m_pPatches;
-        m_pPatches = p->pNext;
-        delete p;
+rad::PatchDivider::PatchDivider(RadSimImpl &radSim)
+    : m_RadSim(radSim) {}
+
+uint64_t rad::PatchDivider::createPatches() {
+    std::vector<Face> &faces = m_RadSim.m_Faces;
+    m_Arenas.clear();
+    m_Arenas.resize(m_RadSim.m_pExecutor->num_workers());
+    m_FacePatches.clear();
+    m_FacePatches.resize(faces.size());
+
+    auto fnProcessFace = [&](size_t faceIdx) {
+        const Face &face = faces[faceIdx];
+
+        if (!face.hasLightmap()) {
+            return;
+        }
+
+        unsigned arenaIdx = (unsigned)m_RadSim.m_pExecutor->this_worker_id();
+        std::vector<MiniPatch> &arena = m_Arenas[arenaIdx];
+        FacePatches &facePatches = m_FacePatches[faceIdx];
+        facePatches.uArena = arenaIdx;
+        facePatches.uOffset = arena.size();
+        facePatches.uCount = createFacePatches(face, arena);
+    };
+
+    tf::Taskflow taskflow;
+    taskflow.for_each_index_dynamic(size_t(0), faces.size(), size_t(1), fnProcessFace,
+                                    size_t(16));
+    m_RadSim.m_pExecutor->run(taskflow).wait();
+
+    // Assign patch indices in face order so that the result doesn't depend on scheduling
+    uint64_t totalPatchCount = 0;
+
+    for (size_t i = 0; i < faces.size(); i++) {
+        Face &face = faces[i];
+
+        if (!face.hasLightmap()) {
+            continue;
+        }
+
+        face.iFirstPatch = (PatchIndex)totalPatchCount;
+        face.iNumPatches = m_FacePatches[i].uCount;
+        totalPatchCount += m_FacePatches[i].uCount;
     }
+
+    return totalPatchCount;
 }
 
-rad::PatchIndex rad::PatchDivider::createPatches(RadSimImpl *pRadSim, Face &face,
-                                                 PatchIndex offset) {
+rad::PatchIndex rad::PatchDivider::transferPatches(appfw::SHA256 &hash) {
+    std::vector<Face> &faces = m_RadSim.m_Faces;
+    std::vector<appfw::SHA256::Digest> faceDigests(faces.size());
+
+    auto fnProcessFace = [&](size_t faceIdx) {
+        Face &face = faces[faceIdx];
+
+        if (!face.hasLightmap()) {
+            return;
+        }
+
+        transferFacePatches(face, m_FacePatches[faceIdx], faceDigests[faceIdx]);
+    };
+
+    tf::Taskflow taskflow;
+    taskflow.for_each_index_dynamic(size_t(0), faces.size(), size_t(1), fnProcessFace,
+                                    size_t(16));
+    m_RadSim.m_pExecutor->run(taskflow).wait();
+
+    // Combine face hashes
+    PatchIndex count = 0;
+
+    for (size_t i = 0; i < faces.size(); i++) {
+        if (faces[i].hasLightmap()) {
+            hash.update(faceDigests[i].data(), faceDigests[i].size());
+            count += faces[i].iNumPatches;
+        }
+    }
+
+    m_Arenas.clear();
+    m_FacePatches.clear();
+    return count;
+}
+
+rad::PatchIndex rad::PatchDivider::createFacePatches(const Face &face,
+                                                     std::vector<MiniPatch> &arena) {
     // Calculate base size of patch grid (wide x tall patches of flPatchSize)
     glm::vec2 faceSize = face.vFaceMaxs - face.vFaceMins;
     glm::vec2 baseGridSizeFloat = faceSize / face.flPatchSize;
@@ -18,75 +93,36 @@ rad::PatchIndex rad::PatchDivider::createPatches(RadSimImpl *pRadSim, Face &face
     baseGridSize.y = texFloatToInt(baseGridSizeFloat.y);
 
     // Allow small patches for small faces
-    float flMinPatchSize = pRadSim->getMinPatchSize();
+    float flMinPatchSize = m_RadSim.getMinPatchSize();
     if (faceSize.x <= SMALL_FACE_SIZE || faceSize.y <= SMALL_FACE_SIZE) {
         flMinPatchSize = MIN_PATCH_SIZE_FOR_SMALL_FACES;
     }
 
-    // Create an empty first patch
-    MiniPatch emptyPatch;
-    MiniPatch *pPrevPatch = &emptyPatch;
     PatchIndex patchCount = 0;
 
     for (int y = 0; y < baseGridSize.y; y++) {
         for (int x = 0; x < baseGridSize.x; x++) {
             MiniPatch patch;
-            patch.pFace = &face;
             patch.flSize = face.flPatchSize;
             patch.vFaceOrigin = face.vFaceMins + glm::vec2(x, y) / baseGridSizeFloat * faceSize;
-
-            MiniPatch *subdNewFirstPatch = nullptr;
-            MiniPatch *subdNewLastPatch = nullptr;
-            bool keepPatch = true;
-            patchCount += subdividePatch(face, &patch, subdNewFirstPatch, subdNewLastPatch,
-                                         keepPatch, flMinPatchSize);
-
-            if (keepPatch) {
-                AFW_ASSERT(!subdNewFirstPatch && !subdNewLastPatch);
-                MiniPatch *newPatch = new MiniPatch(patch);
-                pPrevPatch->pNext = newPatch;
-                pPrevPatch = newPatch;
-                patchCount++;
-            } else {
-                if (subdNewFirstPatch) {
-                    AFW_ASSERT(subdNewLastPatch);
-                    pPrevPatch->pNext = subdNewFirstPatch;
-                    pPrevPatch = subdNewLastPatch;
-                }
-            }
+            patchCount += subdividePatch(face, patch, flMinPatchSize, arena);
         }
     }
 
-    // Save patch indicies in the face
-    face.iFirstPatch = offset;
-    face.iNumPatches = patchCount;
-
-    if (patchCount > 0) {
-        if (m_pPatches) {
-            AFW_ASSERT(m_pLastPatch);
-            AFW_ASSERT(!m_pLastPatch->pNext);
-            AFW_ASSERT(!pPrevPatch->pNext);
-            m_pLastPatch->pNext = emptyPatch.pNext;
-        } else {
-            m_pPatches = emptyPatch.pNext;
-        }
-
-        m_pLastPatch = pPrevPatch;
-    }
-
     return patchCount;
 }
 
-rad::PatchIndex rad::PatchDivider::transferPatches(RadSimImpl *pRadSim, appfw::SHA256 &hash) {
-    PatchIndex count = 0;
-    MiniPatch *p = m_pPatches;
+void rad::PatchDivider::transferFacePatches(Face &face, const FacePatches &facePatches,
+                                            appfw::SHA256::Digest &digest) {
+    const MiniPatch *miniPatches = m_Arenas[facePatches.uArena].data() + facePatches.uOffset;
+    appfw::SHA256 hash;
 
-    while (p) {
-        Face &face = *p->pFace;
-        PatchRef patch(pRadSim->m_Patches, count);
+    for (PatchIndex i = 0; i < facePatches.uCount; i++) {
+        const MiniPatch &p = miniPatches[i];
+        PatchRef patch(m_RadSim.m_Patches, face.iFirstPatch + i);
 
-        glm::vec2 faceOrg = p->vFaceOrigin + glm::vec2(p->flSize / 2.0f);
-        patch.getSize() = p->flSize;
+        glm::vec2 faceOrg = p.vFaceOrigin + glm::vec2(p.flSize / 2.0f);
+        patch.getSize() = p.flSize;
         patch.getFaceOrigin() = faceOrg;
         patch.getOrigin() = face.faceToWorld(faceOrg);
         patch.getRealOrigin() = patch.getOrigin() + face.vBrushOrigin; 
@@ -97,119 +133,74 @@ rad::PatchIndex rad::PatchDivider::transferPatches(RadSimImpl *pRadSim, appfw::S
         // Add origin and normal to hash
         hash.update(reinterpret_cast<uint8_t *>(&patch.getRealOrigin()), sizeof(glm::vec3));
         hash.update(reinterpret_cast<uint8_t *>(&patch.getNormal()), sizeof(glm::vec3));
-
-        count++;
-
-        MiniPatch *del = p;
-        p = p->pNext;
-        delete del;
     }
 
-    m_pPatches = nullptr;
-    return count;
+    digest = hash.digest();
 }
 
-rad::PatchIndex rad::PatchDivider::subdividePatch(Face &face, MiniPatch *patch,
-                                                  MiniPatch *&newFirstPatch,
-                                                  MiniPatch *&newLastPatch, bool &keepPatch,
-                                                  float flMinPatchSize) {
-    AFW_ASSERT(!patch->pNext);
+rad::PatchIndex rad::PatchDivider::subdividePatch(const Face &face, const MiniPatch &patch,
+                                                  float flMinPatchSize,
+                                                  std::vector<MiniPatch> &arena) {
     PatchPos pos = checkPatchPos(face, patch);
 
     if (pos == PatchPos::Inside) {
         // Keep the patch as is
-        keepPatch = true;
-        return 0;
+        arena.push_back(patch);
+        return 1;
     } else if (pos == PatchPos::Outside) {
         // Remove it
-        keepPatch = false;
         return 0;
     }
 
-    float divSize = patch->flSize / 2.0f;
+    float divSize = patch.flSize / 2.0f;
     if (divSize < flMinPatchSize) {
         // Patch is too small for subdivision, keep only if the center is in face
-        keepPatch = isInFace(face, patch->vFaceOrigin + glm::vec2(patch->flSize / 2.0f));
+        if (isInFace(face, patch.vFaceOrigin + glm::vec2(patch.flSize / 2.0f))) {
+            arena.push_back(patch);
+            return 1;
+        }
+
         return 0;
     }
 
     // Patch needs to be divided into 4 smaller patches
-    keepPatch = false;
-    newFirstPatch = nullptr;
-    newLastPatch = nullptr;
     MiniPatch newPatches[4];
-    bool keepNewPatches[4];
     PatchIndex createdPatches = 0;
 
-    newPatches[0].vFaceOrigin = patch->vFaceOrigin;
+    newPatches[0].vFaceOrigin = patch.vFaceOrigin;
 
-    newPatches[1].vFaceOrigin = patch->vFaceOrigin;
+    newPatches[1].vFaceOrigin = patch.vFaceOrigin;
     newPatches[1].vFaceOrigin.x += divSize;
 
-    newPatches[2].vFaceOrigin = patch->vFaceOrigin;
+    newPatches[2].vFaceOrigin = patch.vFaceOrigin;
     newPatches[2].vFaceOrigin.y += divSize;
 
-    newPatches[3].vFaceOrigin = patch->vFaceOrigin;
+    newPatches[3].vFaceOrigin = patch.vFaceOrigin;
     newPatches[3].vFaceOrigin.x += divSize;
     newPatches[3].vFaceOrigin.y += divSize;
 
     for (size_t i = 0; i < 4; i++) {
         newPatches[i].flSize = divSize;
-        newPatches[i].pFace = &face;
-
-        MiniPatch *subdNewFirstPatch = nullptr;
-        MiniPatch *subdNewLastPatch = nullptr;
-        createdPatches += subdividePatch(face, &newPatches[i], subdNewFirstPatch, subdNewLastPatch,
-                                         keepNewPatches[i], flMinPatchSize);
-
-        if (keepNewPatches[i]) {
-            AFW_ASSERT(!subdNewFirstPatch && !subdNewLastPatch);
-            MiniPatch *newPatch = new MiniPatch(newPatches[i]);
-            createdPatches++;
-
-            if (!newFirstPatch) {
-                AFW_ASSERT(!newLastPatch);
-                newFirstPatch = newPatch;
-            } else {
-                AFW_ASSERT(newLastPatch);
-                newLastPatch->pNext = newPatch;
-            }
-
-            newLastPatch = newPatch;
-        } else {
-            if (subdNewFirstPatch) {
-                AFW_ASSERT(subdNewLastPatch);
-
-                if (!newFirstPatch) {
-                    AFW_ASSERT(!newLastPatch);
-                    newFirstPatch = subdNewFirstPatch;
-                } else {
-                    AFW_ASSERT(newLastPatch);
-                    newLastPatch->pNext = subdNewFirstPatch;
-                }
-
-                newLastPatch = subdNewLastPatch;
-            }
-        }
+        createdPatches += subdividePatch(face, newPatches[i], flMinPatchSize, arena);
     }
 
     return createdPatches;
 }
 
-rad::PatchDivider::PatchPos rad::PatchDivider::checkPatchPos(Face &face,
-                                                             MiniPatch *patch) noexcept {
+rad::PatchDivider::PatchPos rad::PatchDivider::checkPatchPos(const Face &face,
+                                                             const MiniPatch &patch) noexcept {
     glm::vec2 corners[4];
-    corners[0] = patch->vFaceOrigin;
+    corners[0] = patch.vFaceOrigin;
 
-    corners[1] = patch->vFaceOrigin;
-    corners[1].x += patch->flSize;
+    corners[1] = patch.vFaceOrigin;
+    corners[1].x += patch.flSize;
 
-    corners[2] = patch->vFaceOrigin;
-    corners[2].y += patch->flSize;
+    corners[2] = patch.vFaceOrigin;
+    corners[2].y += patch.flSize;
 
-    corners[3] = patch->vFaceOrigin;
-    corners[3].x += patch->flSize;
-    corners[3].y += patch->flSize;
+    corners[3] = patch.vFaceOrigin;
+    corners[3].x += patch.flSize;
+    corners[3].y += patch.flSize;
 
     int count = 0;
 
@@ -234,7 +225,7 @@ rad::PatchDivider::PatchPos rad::PatchDivider::checkPatchPos(Face &face,
     }
 }
 
-bool rad::PatchDivider::isInFace(Face &face, glm::vec2 point2d) noexcept {
+bool rad::PatchDivider::isInFace(const Face &face, glm::vec2 point2d) noexcept {
     size_t count = face.vertices.size();
     glm::vec3 point = face.faceToWorld(point2d);
 
@@ -252,7 +243,7 @@ bool rad::PatchDivider::isInFace(Face &face, glm::vec2 point2d) noexcept {
     return true;
 }
 
-bool rad::PatchDivider::pointInWithPatch(glm::vec2 point, MiniPatch *patch) {
-    return (point.x >= patch->vFaceOrigin.x && point.x <= patch->vFaceOrigin.x + patch->flSize) &&
-           (point.y >= patch->vFaceOrigin.y && point.y <= patch->vFaceOrigin.y + patch->flSize);
+bool rad::PatchDivider::pointInWithPatch(glm::vec2 point, const MiniPatch &patch) {
+    return (point.x >= patch.vFaceOrigin.x && point.x <= patch.vFaceOrigin.x + patch.flSize) &&
+           (point.y >= patch.vFaceOrigin.y && point.y <= patch.vFaceOrigin.y + patch.flSize);
 }
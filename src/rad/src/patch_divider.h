@@ -8,18 +8,20 @@ namespace rad {
 
 //! Divides surfaces into patches. Patches that don't completely fit onto the face are subdivided
 //! further until a fixed minimum size. In the end the patches are transferred into the main list.
-//! Can (and should) be called for multiple surface. Not thread-safe.
+//! Faces are processed in parallel, each worker stores its mini-patches in its own arena.
 class PatchDivider : appfw::NoMove {
 public:
-    ~PatchDivider();
-    
-    //! Creates mini-patches for the face. Stored in an internal linked list.
-    //! @returns the number of created patches.
-    PatchIndex createPatches(RadSimImpl *pRadSim, Face &face, PatchIndex offset);
+    PatchDivider(RadSimImpl &radSim);
+
+    //! Creates mini-patches for all faces with lightmaps.
+    //! Sets iFirstPatch and iNumPatches of the faces.
+    //! @returns the total number of created patches.
+    uint64_t createPatches();
 
-    //! Moves patches to the main patch list.
+    //! Moves patches to the main patch list. It must be allocated by the caller.
+    //! Patch positions are hashed per face, face hashes are added to the hash in face order.
     //! @returns the number of created patches.
-    PatchIndex transferPatches(RadSimImpl *pRadSim, appfw::SHA256 &hash);
+    PatchIndex transferPatches(appfw::SHA256 &hash);
 
 private:
     enum class PatchPos
@@ -29,38 +31,50 @@ private:
         Outside          //!< Patch is completely outside the face
     };
 
-    //! Basic patch data. Stored in a linked list before creating full Patch instances.
+    //! Basic patch data. Stored in an arena before creating full Patch instances.
     struct MiniPatch {
-        MiniPatch *pNext = nullptr;
-        Face *pFace = nullptr;
         float flSize = 0;
 
         //! Face coords of the lower corner of the patch (not the center!)
         glm::vec2 vFaceOrigin;
     };
 
-    MiniPatch *m_pPatches = nullptr;
-    MiniPatch *m_pLastPatch = nullptr;
+    //! Location of face's mini-patches.
+    struct FacePatches {
+        unsigned uArena = 0;
+        size_t uOffset = 0;
+        PatchIndex uCount = 0;
+    };
+
+    RadSimImpl &m_RadSim;
+    std::vector<std::vector<MiniPatch>> m_Arenas; //!< Mini-patches of each worker
+    std::vector<FacePatches> m_FacePatches;
+
+    //! Creates mini-patches for the face in the arena.
+    //! @returns the number of created patches.
+    PatchIndex createFacePatches(const Face &face, std::vector<MiniPatch> &arena);
+
+    //! Transfers patches of the face and calculates their hash.
+    void transferFacePatches(Face &face, const FacePatches &facePatches,
+                             appfw::SHA256::Digest &digest);
 
-    //! Divides the patch into up to 4 new patches.
+    //! Divides the patch into up to 4 new patches recursively.
+    //! Patches that are kept are appended to the arena.
     //! @param  patch           Original patch
-    //! @param  newFirstPatch   Will be set to new first patch
-    //! @param  newLastPatch    Will be set to new last patch
-    //! @param  keepPatch       If false, original patch must be removed
     //! @param  flMinPatchSize  Minimum patch size
+    //! @param  arena           Where to store kept patches
     //! @return the number of created patches
-    static PatchIndex subdividePatch(Face &face, MiniPatch *patch, MiniPatch *&newFirstPatch,
-                                     MiniPatch *&newLastPatch, bool &keepPatch,
-                                     float flMinPatchSize);
+    static PatchIndex subdividePatch(const Face &face, const MiniPatch &patch,
+                                     float flMinPatchSize, std::vector<MiniPatch> &arena);
 
     //! @returns how patch is positioned on the face
-    static PatchPos checkPatchPos(Face &face, MiniPatch *patch) noexcept;
+    static PatchPos checkPatchPos(const Face &face, const MiniPatch &patch) noexcept;
 
     //! @returns whether the point is located in the surface polygon.
-    static bool isInFace(Face &face, glm::vec2 point) noexcept;
+    static bool isInFace(const Face &face, glm::vec2 point) noexcept;
 
     //! @returns whether the point is located in the patch.
-    static bool pointInWithPatch(glm::vec2 point, MiniPatch *patch);
+    static bool pointInWithPatch(glm::vec2 point, const MiniPatch &patch);
 };
 
 } // namespace rad
@@ -236,6 +236,7 @@ void rad::RadSimImpl::loadMaterials() {
     m_MatPropLoader.init(m_LevelName, "assets:sound/materials.txt", "assets:materials");
     auto &textures = m_pLevel->getTextures();
     m_Materials.resize(textures.size());
+    std::vector<const bsp::WADTexture *> wadTextures(textures.size());
 
     for (size_t i = 0; i < textures.size(); i++) {
         Material &material = m_Materials[i];
@@ -245,18 +246,11 @@ void rad::RadSimImpl::loadMaterials() {
 
         // Find the texture in WADs
         for (auto &[name, wad] : m_Wads) {
-            auto &wadTextures = wad.getTextures();
-
-            for (const bsp::WADTexture &wadTex : wadTextures) {
-                if (!appfw::strcasecmp(wadTex.getName(), tex.szName)) {
-                    // Found the texture
-                    pWadTex = &wadTex;
-                    wadName = name;
-                    break;
-                }
-            }
+            pWadTex = wad.findTexture(tex.szName);
 
             if (pWadTex) {
+                // Found the texture
+                wadName = name;
                 break;
             }
         }
@@ -267,13 +261,24 @@ void rad::RadSimImpl::loadMaterials() {
         if (pWadTex) {
             // Texture is in the WAD
             material.loadProps(m_MatPropLoader, texName, wadName);
-            material.loadFromWad(*this, *pWadTex);
+            wadTextures[i] = pWadTex;
         } else {
             // Texture is in the level
             material.loadProps(m_MatPropLoader, texName, m_LevelName + ".bsp");
         }
     }
 
+    // Decode WAD textures
+    auto fnLoadTexture = [&](size_t i) {
+        if (wadTextures[i]) {
+            m_Materials[i].loadFromWad(*this, *wadTextures[i]);
+        }
+    };
+
+    tf::Taskflow taskflow;
+    taskflow.for_each_index_dynamic((size_t)0, textures.size(), (size_t)1, fnLoadTexture);
+    m_pExecutor->run(taskflow).wait();
+
     printi("Loaded {} materials", m_Materials.size());
 }
 
@@ -336,22 +341,11 @@ void rad::RadSimImpl::createPatches(appfw::SHA256 &hash) {
     appfw::Timer timer;
     timer.start();
 
-    PatchDivider divider;
-    uint64_t totalPatchCount = 0;
+    PatchDivider divider(*this);
+    uint64_t totalPatchCount = divider.createPatches();
 
-    for (size_t i = 0; i < m_Faces.size(); i++) {
-        Face &face = m_Faces[i];
-
-        if (!face.hasLightmap()) {
-            continue;
-        }
-
-        totalPatchCount += divider.createPatches(this, face, (PatchIndex)totalPatchCount);
-
-        if (totalPatchCount > MAX_PATCH_COUNT) {
-            throw std::runtime_error(
-                fmt::format("Error: Patch limit reached ({})", MAX_PATCH_COUNT));
-        }
+    if (totalPatchCount > MAX_PATCH_COUNT) {
+        throw std::runtime_error(fmt::format("Error: Patch limit reached ({})", MAX_PATCH_COUNT));
     }
 
     //-------------------------------------------------------------------------
@@ -375,7 +369,7 @@ void rad::RadSimImpl::createPatches(appfw::SHA256 &hash) {
     //-------------------------------------------------------------------------
     printn("Transferring patches into the list");
     [[maybe_unused]] PatchIndex transferPatchesCount = 0;
-    transferPatchesCount = divider.transferPatches(this, hash);
+    transferPatchesCount = divider.transferPatches(hash);
     AFW_ASSERT_REL(transferPatchesCount == m_Patches.size());
 
     timer.stop();
@@ -42,29 +42,6 @@ inline glm::dvec3 projectVectorOnPlane(const bsp::BSPPlane &plane, glm::dvec3 ve
     return b - a;
 }
 
-std::vector<glm::vec3> getFaceVertices(const bsp::Level &level, const bsp::BSPFace &face) {
-    std::vector<glm::vec3> verts;
-    auto &lvlVertices = level.getVertices();
-    auto &lvlSurfEdges = level.getSurfEdges();
-
-    for (int j = 0; j < face.nEdges; j++) {
-        glm::vec3 vertex;
-        bsp::BSPSurfEdge iEdgeIdx = lvlSurfEdges.at((size_t)face.iFirstEdge + j);
-
-        if (iEdgeIdx > 0) {
-            const bsp::BSPEdge &edge = level.getEdges().at(iEdgeIdx);
-            vertex = lvlVertices.at(edge.iVertex[0]);
-        } else {
-            const bsp::BSPEdge &edge = level.getEdges().at(-iEdgeIdx);
-            vertex = lvlVertices.at(edge.iVertex[1]);
-        }
-
-        verts.push_back(vertex);
-    }
-
-    return verts;
-}
-
 constexpr glm::vec2 MINS_INIT = {16384, 16384};
 constexpr glm::vec2 MAXS_INIT = {-16384, -16384};
 
@@ -159,7 +136,7 @@ void rad::Face::load(RadSimImpl &radSim, const bsp::BSPFace &bspFace, int faceIn
     }
 
     // Process vertices
-    auto rawVerts = getFaceVertices(*radSim.m_pLevel, bspFace);
+    auto rawVerts = radSim.m_pLevel->getFaceVertices(faceIndex);
     vertices.reserve(rawVerts.size());
     vFaceMins = MINS_INIT;
     vFaceMaxs = MAXS_INIT;
@@ -124,10 +124,9 @@ size_t rad::VisMat::calculateOffsets(std::vector<size_t> &offsets) {
 }
 
 void rad::VisMat::buildVisLeaves(size_t i) {
-    uint8_t pvs[(bsp::MAX_MAP_LEAFS + 7) / 8];
+    uint8_t pvsBuf[bsp::MAX_MAP_LEAFS / 8];
 
     auto &leaves = m_RadSim.m_pLevel->getLeaves();
-    auto &visdata = m_RadSim.m_pLevel->getVisData();
     auto &marksurfaces = m_RadSim.m_pLevel->getMarkSurfaces();
 
     std::vector<uint8_t> face_tested(bsp::MAX_MAP_FACES);
@@ -143,8 +142,7 @@ void rad::VisMat::buildVisLeaves(size_t i) {
         return;
     }
 
-    memset(pvs, 0, sizeof(pvs));
-    decompressVis(&visdata[srcleaf->nVisOffset], pvs);
+    const uint8_t *pvs = m_RadSim.m_pLevel->leafPVS(~(int)i, pvsBuf);
 
     //
     // go through all the faces inside the
@@ -181,7 +179,7 @@ void rad::VisMat::buildVisLeaves(size_t i) {
     m_uFinishedLeaves++;
 }
 
-void rad::VisMat::buildVisRow(PatchIndex patchnum, uint8_t *pvs, size_t bitpos, std::vector<uint8_t> &face_tested) {
+void rad::VisMat::buildVisRow(PatchIndex patchnum, const uint8_t *pvs, size_t bitpos, std::vector<uint8_t> &face_tested) {
     std::fill(face_tested.begin(), face_tested.end(), (uint8_t)0);
 
     auto &leaves = m_RadSim.m_pLevel->getLeaves();
@@ -252,22 +250,3 @@ void rad::VisMat::testPatchToFace(PatchIndex patchnum, int facenum, size_t bitpo
         }
     }
 }
-
-void rad::VisMat::decompressVis(const uint8_t *in, uint8_t *decompressed) {
-    size_t row = (m_RadSim.m_pLevel->getLeaves().size() + 7) >> 3;
-    uint8_t *out = decompressed;
-
-    do {
-        if (*in) {
-            *out++ = *in++;
-            continue;
-        }
-
-        int c = in[1];
-        in += 2;
-        while (c) {
-            *out++ = 0;
-            c--;
-        }
-    } while ((size_t)(out - decompressed) < row);
-}
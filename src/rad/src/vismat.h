@@ -82,10 +82,8 @@ private:
     size_t calculateOffsets(std::vector<size_t> &offsets);
 
     void buildVisLeaves(size_t i);
-    void buildVisRow(PatchIndex patchnum, uint8_t *pvs, size_t bitpos, std::vector<uint8_t> &face_tested);
+    void buildVisRow(PatchIndex patchnum, const uint8_t *pvs, size_t bitpos, std::vector<uint8_t> &face_tested);
     void testPatchToFace(PatchIndex patchnum, int facenum, size_t bitpos);
-
-    void decompressVis(const uint8_t *in, uint8_t *decompressed);
 };
 
 } // namespace rad
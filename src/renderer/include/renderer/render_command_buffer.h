@@ -0,0 +1,131 @@
+#ifndef RENDERER_RENDER_COMMAND_BUFFER_H
+#define RENDERER_RENDER_COMMAND_BUFFER_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include <renderer/const.h>
+
+class Material;
+
+//! A list of draw commands recorded while the scene is processed.
+//! Commands only reference state by value or by pointers to long-living objects (e.g. materials),
+//! so a buffer can be recorded on any thread and replayed later by a graphics backend.
+//! Doesn't call GL.
+class RenderCommandBuffer {
+public:
+    enum class CommandType : uint8_t
+    {
+        BindGeometry,        //!< uArg - Geometry
+        SetDepthFunc,        //!< uArg - DepthFunc
+        SetRenderMode,       //!< uArg - RenderMode
+        EnableMaterial,      //!< pMaterial, uArg - shader type index
+        EnableWireframe,     //!< Enables the brush wireframe shader
+        SetUniforms,         //!< uArg - UniformSet, uFirst - uniforms index
+        DrawRanges,          //!< uArg - Primitive, [uFirst; uFirst + uCount) - vertex ranges
+        DrawArrays,          //!< uArg - Primitive, [uFirst; uFirst + uCount) - vertices
+        DrawEngineTriangles, //!< uArg - 0 for normal, 1 for transparent
+    };
+
+    //! Vertex data sources.
+    enum class Geometry : uint8_t
+    {
+        Surfaces,   //!< Brush surface vertices
+        SpriteQuad, //!< Unit sprite quad
+    };
+
+    enum class Primitive : uint8_t
+    {
+        TriangleFan,
+        LineLoop,
+    };
+
+    enum class DepthFunc : uint8_t
+    {
+        Less,
+        LessEqual,
+    };
+
+    //! Which shader uniforms to set from Uniforms.
+    enum class UniformSet : uint8_t
+    {
+        Brush,     //!< Model matrix, render mode, render FX
+        Sprite,    //!< Brush + frame
+        Wireframe, //!< Color
+    };
+
+    struct Command {
+        CommandType type;
+        uint32_t uArg = 0;
+        uint32_t uFirst = 0;
+        uint32_t uCount = 0;
+        const Material *pMaterial = nullptr;
+    };
+
+    struct Uniforms {
+        glm::mat4 mModelMat = glm::mat4(1.0f);
+        glm::vec3 vColor = glm::vec3(1.0f); //!< FX color or wireframe color, linear [0; 1]
+        float flFxAmount = 0;
+        float flFrame = 0;
+        RenderMode nRenderMode = kRenderNormal;
+    };
+
+    //! Removes all commands. Keeps allocated memory.
+    void clear();
+
+    void bindGeometry(Geometry geometry);
+    void setDepthFunc(DepthFunc func);
+    void setRenderMode(RenderMode mode);
+    void enableMaterial(const Material *material, unsigned shaderType);
+    void enableWireframe();
+
+    //! Stores uniform values.
+    //! @returns index for setUniforms.
+    uint32_t addUniforms(const Uniforms &uniforms);
+
+    //! Sets uniforms of the enabled shader.
+    void setUniforms(UniformSet set, uint32_t uniformsIdx);
+
+    //! Adds a vertex range to be drawn by the next drawRanges.
+    inline void addRange(int32_t first, int32_t count) {
+        m_RangeFirsts.push_back(first);
+        m_RangeCounts.push_back(count);
+    }
+
+    //! @returns whether there are ranges not drawn yet.
+    inline bool hasPendingRanges() const { return m_RangeFirsts.size() > m_uPendingRangesStart; }
+
+    //! Draws ranges added since the last drawRanges as separate primitives.
+    //! Does nothing if there are none.
+    void drawRanges(Primitive primitive);
+
+    //! Draws count vertices starting from first.
+    void drawArrays(Primitive primitive, uint32_t first, uint32_t count);
+
+    //! Lets the engine draw its own triangles.
+    void drawEngineTriangles(bool isTrans);
+
+    inline size_t size() const { return m_Commands.size(); }
+    inline bool empty() const { return m_Commands.empty(); }
+    inline const Command &operator[](size_t i) const { return m_Commands[i]; }
+    inline const Command *begin() const { return m_Commands.data(); }
+    inline const Command *end() const { return m_Commands.data() + m_Commands.size(); }
+
+    inline const Uniforms &getUniforms(uint32_t idx) const { return m_Uniforms[idx]; }
+    inline const int32_t *getRangeFirsts() const { return m_RangeFirsts.data(); }
+    inline const int32_t *getRangeCounts() const { return m_RangeCounts.data(); }
+
+private:
+    std::vector<Command> m_Commands;
+    std::vector<Uniforms> m_Uniforms;
+    std::vector<int32_t> m_RangeFirsts;
+    std::vector<int32_t> m_RangeCounts;
+    size_t m_uPendingRangesStart = 0;
+
+    inline void addCommand(CommandType type, uint32_t arg = 0, uint32_t first = 0,
+                           uint32_t count = 0, const Material *material = nullptr) {
+        m_Commands.push_back({type, arg, first, count, material});
+    }
+};
+
+#endif
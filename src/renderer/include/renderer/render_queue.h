@@ -0,0 +1,58 @@
+#ifndef RENDERER_RENDER_QUEUE_H
+#define RENDERER_RENDER_QUEUE_H
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! A list of items to draw ordered by 64-bit sort keys.
+//! Key layout from the most significant bits:
+//! 8 bits - pass (e.g. render mode rank)
+//! 8 bits - shader (e.g. model type)
+//! 16 bits - material
+//! 32 bits - depth
+//! Items are sorted with a stable radix sort. Doesn't call GL.
+class RenderQueue {
+public:
+    struct Item {
+        uint64_t uKey;
+        uint32_t uIndex; //!< Index of the item in caller's list
+    };
+
+    //! Depth order of items inside of the same pass, shader and material.
+    enum class DepthOrder
+    {
+        FrontToBack,
+        BackToFront,
+    };
+
+    //! Packs key fields into a sort key. Fields are truncated to their widths.
+    static uint64_t makeKey(unsigned pass, unsigned shader, unsigned material, float depth,
+                            DepthOrder order);
+
+    //! Converts a float into an integer with the same order.
+    static uint32_t floatToSortable(float value);
+
+    //! Removes all items. Keeps allocated memory.
+    inline void clear() { m_Items.clear(); }
+
+    //! Adds an item.
+    inline void add(uint64_t key, uint32_t index) { m_Items.push_back({key, index}); }
+
+    //! Sorts items by key in ascending order. Items with equal keys keep their order.
+    void sort();
+
+    inline size_t size() const { return m_Items.size(); }
+    inline bool empty() const { return m_Items.empty(); }
+    inline const Item &operator[](size_t i) const { return m_Items[i]; }
+    inline const Item *begin() const { return m_Items.data(); }
+    inline const Item *end() const { return m_Items.data() + m_Items.size(); }
+
+private:
+    //! Queues smaller than this are sorted with insertion sort.
+    static constexpr size_t MIN_RADIX_SORT_SIZE = 32;
+
+    std::vector<Item> m_Items;
+    std::vector<Item> m_TempItems;
+};
+
+#endif
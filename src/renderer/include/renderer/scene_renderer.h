@@ -11,6 +11,8 @@
 #include <graphics/texture2d.h>
 #include <material_system/material_system.h>
 #include <renderer/client_entity.h>
+#include <renderer/render_command_buffer.h>
+#include <renderer/render_queue.h>
 
 //! Error for checking on which side of plane a point is.
 constexpr float BACKFACE_EPSILON = 0.01f;
@@ -26,7 +28,8 @@ class IRendererEngine;
 
 class SceneRenderer : appfw::NoMove {
 private:
-    struct Surface; // Forward def for ViewContext
+    struct Surface;         // Forward def for ViewContext
+    struct SurfaceCullData; // Forward def for ViewContext
 
 public:
     static constexpr int GLOBAL_UNIFORM_BIND = 0;
@@ -66,6 +69,9 @@ public:
         //! @param   angles  Pitch, yaw and roll in degrees
         void setPerspViewOrigin(const glm::vec3 &origin, const glm::vec3 &angles);
 
+        //! Returns projection type.
+        inline ProjType getProjType() const { return m_Type; }
+
         //! Returns culling mode.
         inline Cull getCulling() const { return m_Cull; }
 
@@ -87,17 +93,46 @@ public:
         //! Returns view matrix.
         inline const glm::mat4 &getViewMatrix() const { return m_ViewMat; }
 
+        //! Bit mask of all frustum planes.
+        static constexpr unsigned FRUSTUM_ALL_PLANES = (1u << 6) - 1;
+
         //! Checks if an AABB is in view frustum.
         //! @returns true if the box is culled and not drawn.
         bool cullBox(glm::vec3 mins, glm::vec3 maxs) const;
 
+        //! Checks an AABB against frustum planes set in planeMask.
+        //! Clears bits of planes the box is completely in front of. Boxes inside of it don't need
+        //! to be tested against these planes.
+        //! @returns true if the box is culled and not drawn.
+        bool cullBox(glm::vec3 mins, glm::vec3 maxs, unsigned &planeMask) const;
+
         //! Checks if a surface is in view and with correct side.
         //! @returns true if the surface is culled and not drawn.
         bool cullSurface(const Surface &surface) const;
 
+        //! Checks surfaces [first; first + count) using SoA culling data, several at a time.
+        //! Same result as cullSurface for each surface.
+        //! @param  visMask     Set bit i means surface (first + i) is visible.
+        //!                     Must have space for (count + 31) / 32 words.
+        //! @param  planeMask   Frustum planes to test against, see cullBox.
+        void cullSurfaces(const SurfaceCullData &data, unsigned first, unsigned count,
+                          uint32_t *visMask, unsigned planeMask = FRUSTUM_ALL_PLANES) const;
+
         //! Sets up frustum for current origin and angles. Must be called before usage.
         void setupFrustum();
 
+        //! Sets up a frustum that contains frustums of all views with the same projection that
+        //! are within flDistMargin units and flAngleMargin degrees of rotation from this one.
+        //! Backface culling is relaxed by flDistMargin as well.
+        //! @returns false if FOV is too wide to be padded. Regular frustum is set up then.
+        bool setupPaddedFrustum(float flDistMargin, float flAngleMargin);
+
+        //! @returns whether this view has the same projection and culling as the other one and
+        //! is within flDistMargin units and flAngleMargin degrees of rotation from it.
+        //! Both contexts must have their frustums set up.
+        bool isWithinMargins(const ViewContext &other, float flDistMargin,
+                             float flAngleMargin) const;
+
     private:
         struct Plane {
             glm::vec3 vNormal;
@@ -107,6 +142,7 @@ public:
 
         ProjType m_Type = ProjType::None;
         Cull m_Cull = Cull::Back;
+        float m_flBackfaceEpsilon = BACKFACE_EPSILON;
         glm::mat4 m_ProjMat;
         glm::mat4 m_ViewMat;
 
@@ -129,6 +165,14 @@ public:
         //! 4 - near
         //! 5 - far
         Plane m_Frustum[6];
+
+        //! @returns how many degrees left/right (x) and bottom/top (y) planes need to be
+        //! rotated outwards to contain the frustum rotated by up to flAngleMargin degrees
+        //! around any axis.
+        glm::vec2 getPlaneAngleMargins(float flAngleMargin) const;
+
+        //! Sets up frustum planes moved outwards by the margins.
+        void setupFrustumPlanes(float flDistMargin, float flAngleMargin);
     };
 
     SceneRenderer(bsp::Level &level, std::string_view path, IRendererEngine &engine);
@@ -143,6 +187,16 @@ public:
     //! @returns the view context.
     inline ViewContext &getViewContext() { return m_ViewContext; }
 
+    //! Determines visible world surfaces, sorts entities for the current view context and records
+    //! draw commands. Entities must be added before. Doesn't use OpenGL and only modifies per-view
+    //! data, so different renderers can be prepared in parallel.
+    //! renderScene calls it if the scene wasn't prepared after last change of the entity list.
+    void prepareScene();
+
+    //! Prepares scenes of several renderers in parallel using the app executor.
+    //! Renderers must be different objects. Rendering must still be done on the GL thread.
+    static void prepareScenes(appfw::span<SceneRenderer *const> renderers);
+
     //! Renders the image to the framebuffer.
     //! @param  targetFb    Framebuffer to draw to
     //! @param  flSimTime   Current simulation time
@@ -162,6 +216,13 @@ public:
     //! @returns the material used by the surface.
     Material *getSurfaceMaterial(int surface);
 
+    //! Sets brush models that are drawn as a part of the world instead of as entities.
+    //! Models must be placed at world origin, never move and use normal render mode.
+    //! Entities using them must not be added with addEntity.
+    //! They are drawn in the world pass, so both r_drawworld 0 and r_drawents 0 hide them,
+    //! and they don't count towards MAX_VISIBLE_ENTS.
+    void setStaticBrushModels(appfw::span<const Model *const> models);
+
     //! Sets linear intensity scale of a lightstyle.
     inline void setLightstyleScale(int lightstyle, float scale) {
         m_flLightstyleScales[lightstyle] = scale;
@@ -182,13 +243,7 @@ private:
     class WorldRenderer;
     class BrushRenderer;
     class SpriteRenderer;
-
-    //! Maximum number of vertices. Limited by two byte vertex index in the EBO,
-    //! (2^16 - 1) is reserved for primitive restart.
-    static constexpr uint16_t MAX_SURF_VERTEX_COUNT = std::numeric_limits<uint16_t>::max() - 1;
-
-    //! Vertex index for primitive restart.
-    static constexpr uint16_t PRIMITIVE_RESTART_IDX = std::numeric_limits<uint16_t>::max();
+    class GLCommandExecutor;
 
     struct SurfaceVertex {
         glm::vec3 position;
@@ -198,7 +253,7 @@ private:
 
     struct LightmapVertex {
         glm::ivec4 lightstyle;
-        glm::vec2 texture;
+        glm::vec3 texture; //!< xy - texture coords, z - lightmap page
     };
 
     struct Surface {
@@ -217,13 +272,25 @@ private:
         int vertexCount = 0;  //!< Number of vertices
     };
 
+    //! Surface bounds and planes stored as structure of arrays for batched culling.
+    //! Arrays are padded with SIMD_WIDTH extra items.
+    struct SurfaceCullData {
+        static constexpr unsigned SIMD_WIDTH = 4;
+
+        std::vector<float> mins[3];
+        std::vector<float> maxs[3];
+        std::vector<float> normal[3]; //!< Front side plane normal (flipped for SURF_PLANEBACK)
+        std::vector<float> dist;      //!< Front side plane distance
+    };
+
     struct GlobalUniform {
         glm::mat4 mMainProj;
         glm::mat4 mMainView;
         glm::vec4 vMainViewOrigin; // xyz
         glm::vec4 vflParams1;      // x tex gamma, y screen gamma, z sim time, w sim time delta
         glm::vec4 vflParams2;      // x lightmap gamma
-        glm::ivec4 viParams1;      // x is texture type, y is lighting type
+        glm::ivec4 viParams1;      // x tex type, y lighting type, z LM page layers, w LM black layer
+        glm::ivec4 viLMLayers;     // LM page layer of each lightstyle slot or -1 for black layer
     };
 
     struct RenderingStats {
@@ -231,7 +298,7 @@ private:
         unsigned uSkyPolys = 0;
         unsigned uBrushEntPolys = 0;
         unsigned uDrawCalls = 0;
-        unsigned uEboOverflows = 0;
+        unsigned uCommands = 0;
         double flFrameTime = 0;
     };
 
@@ -243,6 +310,7 @@ private:
     std::unique_ptr<WorldRenderer> m_pWorldRenderer;
     std::unique_ptr<BrushRenderer> m_pBrushRenderer;
     std::unique_ptr<SpriteRenderer> m_pSpriteRenderer;
+    std::unique_ptr<GLCommandExecutor> m_pCommandExecutor;
 
     // Viewport
     glm::ivec2 m_vViewportSize = glm::ivec2(0, 0);
@@ -260,9 +328,9 @@ private:
     std::unordered_map<Material *, unsigned> m_MaterialIndexes; //!< Maps materials to their unique indexes.
     unsigned m_uNextMaterialIndex = 0;
     std::vector<Surface> m_Surfaces;         //!< BSP surfaces
+    SurfaceCullData m_SurfaceCullData;       //!< Bounds and planes of m_Surfaces
     GPUBuffer m_SurfaceVertexBuffer;         //!< Surface vertices
     unsigned m_uSurfaceVertexBufferSize = 0; //!< Number of brush vertices
-    unsigned m_uMaxEboSize = 0;              //!< Maximum number of elelements in the EBO
     GLVao m_SurfaceVao;
     Material *m_pSkyboxMaterial = nullptr;
 
@@ -284,8 +352,12 @@ private:
     std::vector<ClientEntity *> m_SolidEntityList;
     std::vector<ClientEntity *> m_TransEntityList;
     unsigned m_uVisibleEntCount = 0;
+    RenderQueue m_EntityQueue;
+    std::vector<ClientEntity *> m_EntitySortBuffer;
 
     ViewContext m_ViewContext;
+    RenderCommandBuffer m_CommandBuffer;
+    bool m_bIsScenePrepared = false;
 
     //----------------------------------------------------------------
     // Initialization
@@ -293,6 +365,9 @@ private:
     //! Initializes m_Surfaces.
     void initSurfaces();
 
+    //! Fills m_SurfaceCullData from m_Surfaces.
+    void initSurfaceCullData();
+
     //! Creates global uniform buffer.
     void createGlobalUniform();
 
@@ -336,17 +411,29 @@ private:
     //! Reverts viewRenderingSetup
     void viewRenderingEnd();
 
-    //! Renders world polygons
-    void drawWorld();
+    //! Records draw commands of the scene into m_CommandBuffer.
+    void recordCommands();
+
+    //! Records world polygons
+    void recordWorld();
+
+    //! Records entities
+    void recordEntities();
+
+    //! Sorts opaque entities for rendering.
+    void sortSolidEntities();
+
+    //! Sorts transparent entities for rendering.
+    void sortTransEntities();
 
-    //! Renders entities
-    void drawEntities();
+    //! Reorders the entity list in the order of sorted m_EntityQueue.
+    void applyEntityQueue(std::vector<ClientEntity *> &list);
 
-    //! Renders opaque entities
-    void drawSolidEntities();
+    //! Records opaque entities
+    void recordSolidEntities();
 
-    //! Renders transparent entities
-    void drawTransEntities();
+    //! Records transparent entities
+    void recordTransEntities();
 
     //! Blits the HDR backbuffer into current framebuffer.
     void postProcessBlit();
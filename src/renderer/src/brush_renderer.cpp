@@ -3,134 +3,65 @@
 #include "brush_renderer.h"
 
 SceneRenderer::BrushRenderer::BrushRenderer(SceneRenderer &renderer)
-    : m_Renderer(renderer) {
-    createBuffers();
-}
-
-void SceneRenderer::BrushRenderer::beginRendering() {
-    batchReset();
-}
+    : m_Renderer(renderer) {}
 
-void SceneRenderer::BrushRenderer::drawBrushEntity(const ViewContext &context,
-                                                        ClientEntity *clent) {
+void SceneRenderer::BrushRenderer::drawBrushEntity(const ViewContext &context, ClientEntity *clent,
+                                                   RenderCommandBuffer &cmds) {
     EntData entData;
     if (prepareEntity(context, clent, entData)) {
         return;
     }
 
-    // Set up GL
-    glBindVertexArray(m_Renderer.m_SurfaceVao);
-    m_WorldEbo.bind();
-    m_Renderer.setRenderMode(clent->iRenderMode);
+    beginEntity(cmds, clent, entData);
 
     // Draw surfaces
     Model *model = clent->pModel;
 
     for (unsigned i = 0; i < model->uFaceNum; i++) {
         unsigned surfIdx = model->uFirstFace + i;
-        const Surface &surf = m_Renderer.m_Surfaces[surfIdx];
-
-        if (surf.material != m_pBatchMaterial) {
-            batchFlush();
-            m_pBatchMaterial = surf.material;
-            m_pBatchMaterial->activateTextures();
-            auto &shader = m_pBatchMaterial
-                               ->enableShader(SHADER_TYPE_BRUSH_MODEL_IDX, m_Renderer.m_uFrameCount)
-                               ->getShader<SceneShaders::BrushShader>();
-            shader.setModelMatrix(entData.transformMat);
-            shader.setRenderMode(clent->iRenderMode);
-            shader.setRenderFx(clent->iFxAmount / 255.f, glm::vec3(clent->vFxColor) / 255.0f);
-        }
-
-        batchAddSurface(surf);
+        addSurface(cmds, entData, m_Renderer.m_Surfaces[surfIdx]);
     }
 
-    batchFlush();
+    cmds.drawRanges(RenderCommandBuffer::Primitive::TriangleFan);
     m_Renderer.m_Stats.uBrushEntPolys += model->uFaceNum;
 }
 
 void SceneRenderer::BrushRenderer::drawSortedBrushEntity(const ViewContext &context,
-                                                         ClientEntity *clent) {
+                                                         ClientEntity *clent,
+                                                         RenderCommandBuffer &cmds) {
     EntData entData;
     if (prepareEntity(context, clent, entData)) {
         return;
     }
 
-    // Set up GL
-    glBindVertexArray(m_Renderer.m_SurfaceVao);
-    m_WorldEbo.bind();
-    m_Renderer.setRenderMode(clent->iRenderMode);
+    beginEntity(cmds, clent, entData);
 
     Model *model = clent->pModel;
-    m_SortBuffer.clear();
+    auto &surfaces = m_Renderer.m_Surfaces;
+    m_SortQueue.clear();
 
-    // Sort surfaces
+    // Sort surfaces back to front
     for (unsigned i = 0; i < model->uFaceNum; i++) {
         unsigned surfIdx = model->uFirstFace + i;
-        m_SortBuffer.push_back(surfIdx);
-    }
 
-    auto &surfaces = m_Renderer.m_Surfaces;
-    auto sortFn = [&](const size_t &lhsIdx, const size_t &rhsIdx) {
         // TODO: Doesn't account for rotation
-        glm::vec3 lhsOrg = surfaces[lhsIdx].vOrigin + clent->vOrigin;
-        glm::vec3 rhsOrg = surfaces[rhsIdx].vOrigin + clent->vOrigin;
-        float lhsDist = glm::dot(lhsOrg, context.getViewForward());
-        float rhsDist = glm::dot(rhsOrg, context.getViewForward());
-
-        return lhsDist > rhsDist;
-    };
+        glm::vec3 org = surfaces[surfIdx].vOrigin + clent->vOrigin;
+        float dist = glm::dot(org, context.getViewForward());
+        m_SortQueue.add(RenderQueue::makeKey(0, 0, 0, dist, RenderQueue::DepthOrder::BackToFront),
+                        surfIdx);
+    }
 
-    std::sort(m_SortBuffer.begin(), m_SortBuffer.end(), sortFn);
+    m_SortQueue.sort();
 
     // Draw surfaces
-    for (unsigned surfIdx : m_SortBuffer) {
-        const Surface &surf = m_Renderer.m_Surfaces[surfIdx];
-
-        if (surf.material != m_pBatchMaterial) {
-            batchFlush();
-            m_pBatchMaterial = surf.material;
-            m_pBatchMaterial->activateTextures();
-            auto &shader = m_pBatchMaterial
-                               ->enableShader(SHADER_TYPE_BRUSH_MODEL_IDX, m_Renderer.m_uFrameCount)
-                               ->getShader<SceneShaders::BrushShader>();
-            shader.setModelMatrix(entData.transformMat);
-            shader.setRenderMode(clent->iRenderMode);
-            shader.setRenderFx(clent->iFxAmount / 255.f, glm::vec3(clent->vFxColor) / 255.0f);
-        }
-
-        batchAddSurface(surf);
+    for (const RenderQueue::Item &item : m_SortQueue) {
+        addSurface(cmds, entData, surfaces[item.uIndex]);
     }
 
-    batchFlush();
+    cmds.drawRanges(RenderCommandBuffer::Primitive::TriangleFan);
     m_Renderer.m_Stats.uBrushEntPolys += model->uFaceNum;
 }
 
-void SceneRenderer::BrushRenderer::createBuffers() {
-    auto &models = m_Renderer.m_Level.getModels();
-    if (models.size() < 2) {
-        return;
-    }
-
-    // All bmodel faces go after world faces
-    unsigned totalSurfCount = (unsigned)m_Renderer.m_Surfaces.size();
-    unsigned vertexCount = 0;
-    unsigned surfaceCount = 0;
-    for (unsigned i = models[1].iFirstFace; i < totalSurfCount; i++) {
-        const Surface &surf = m_Renderer.m_Surfaces[i];
-        vertexCount += surf.vertexCount;
-        surfaceCount++;
-    }
-
-    // Maximum ebo size is X vertices + Y primitive restarts.
-    // X = max vertex count, Y = max surface count.
-    unsigned maxEboSize = vertexCount + surfaceCount;
-    m_WorldEboBuf.resize(maxEboSize);
-    m_WorldEbo.create(GL_ELEMENT_ARRAY_BUFFER, "BrushRenderer: EBO");
-    m_WorldEbo.init(maxEboSize * sizeof(uint16_t), nullptr, GL_DYNAMIC_DRAW);
-    printi("BrushRenderer: EBO is {:.1f} KiB", m_WorldEbo.getMemUsage() / 1024.0);
-}
-
 bool SceneRenderer::BrushRenderer::prepareEntity(const ViewContext &context,
                                                  const ClientEntity *clent,
                                                  EntData &entData) const {
@@ -165,45 +96,30 @@ glm::mat4 SceneRenderer::BrushRenderer::getBrushTransform(const ClientEntity *cl
     return modelMat;
 }
 
-void SceneRenderer::BrushRenderer::batchAddSurface(const Surface &surf) {
-    if (m_uWorldEboIdx + surf.vertexCount >= m_WorldEboBuf.size()) {
-        // EBO overflow
-        batchFlush();
-        batchReset();
-        m_Renderer.m_Stats.uEboOverflows++;
-    }
-
-    for (uint16_t j = 0; j < surf.vertexCount; j++) {
-        m_WorldEboBuf[m_uWorldEboIdx + j] = (uint16_t)surf.vertexOffset + j;
-    }
-
-    m_WorldEboBuf[m_uWorldEboIdx + surf.vertexCount] = PRIMITIVE_RESTART_IDX;
-    m_uWorldEboIdx += surf.vertexCount + 1;
+void SceneRenderer::BrushRenderer::beginEntity(RenderCommandBuffer &cmds,
+                                               const ClientEntity *clent,
+                                               EntData &entData) const {
+    RenderCommandBuffer::Uniforms uniforms;
+    uniforms.mModelMat = entData.transformMat;
+    uniforms.nRenderMode = clent->iRenderMode;
+    uniforms.flFxAmount = clent->iFxAmount / 255.0f;
+    uniforms.vColor = glm::vec3(clent->vFxColor) / 255.0f;
+    entData.uUniformsIdx = cmds.addUniforms(uniforms);
+
+    cmds.bindGeometry(RenderCommandBuffer::Geometry::Surfaces);
+    cmds.setRenderMode(clent->iRenderMode);
 }
 
-void SceneRenderer::BrushRenderer::batchFlush() {
-    if (m_uWorldEboOffset == m_uWorldEboIdx) {
-        return;
-    }
-
-    // Decrement EBO size to remove last PRIMITIVE_RESTART_IDX
-    m_uWorldEboIdx--;
-
-    // Update EBO
-    m_WorldEbo.update(m_uWorldEboOffset * sizeof(uint16_t),
-                      (m_uWorldEboIdx - m_uWorldEboOffset) * sizeof(uint16_t),
-                      m_WorldEboBuf.data() + m_uWorldEboOffset);
+void SceneRenderer::BrushRenderer::addSurface(RenderCommandBuffer &cmds, EntData &entData,
+                                              const Surface &surf) const {
+    if (surf.material != entData.pMaterial) {
+        // Draw surfaces of previous material
+        cmds.drawRanges(RenderCommandBuffer::Primitive::TriangleFan);
 
-    // Draw elements
-    glDrawElements(GL_TRIANGLE_FAN, (m_uWorldEboIdx - m_uWorldEboOffset), GL_UNSIGNED_SHORT,
-                   reinterpret_cast<const void *>(m_uWorldEboOffset * sizeof(uint16_t)));
-    m_Renderer.m_Stats.uDrawCalls++;
-
-    m_uWorldEboOffset = m_uWorldEboIdx;
-}
+        entData.pMaterial = surf.material;
+        cmds.enableMaterial(surf.material, SHADER_TYPE_BRUSH_MODEL_IDX);
+        cmds.setUniforms(RenderCommandBuffer::UniformSet::Brush, entData.uUniformsIdx);
+    }
 
-void SceneRenderer::BrushRenderer::batchReset() {
-    m_uWorldEboIdx = 0;
-    m_uWorldEboOffset = 0;
-    m_pBatchMaterial = nullptr;
+    cmds.addRange(surf.vertexOffset, surf.vertexCount);
 }
@@ -6,34 +6,25 @@ class SceneRenderer::BrushRenderer {
 public:
     BrushRenderer(SceneRenderer &renderer);
 
-    //! Called when bmodels are rendered again for a different context.
-    //! Resets the EBO.
-    void beginRendering();
-
-    //! Renders a brush model without sorting its surfaces.
+    //! Records commands that render a brush model without sorting its surfaces.
     //! Good for opaque entities.
-    void drawBrushEntity(const ViewContext &context, ClientEntity *clent);
+    void drawBrushEntity(const ViewContext &context, ClientEntity *clent,
+                         RenderCommandBuffer &cmds);
 
-    //! Renders a brush model with surfaces sorted.
+    //! Records commands that render a brush model with surfaces sorted.
     //! Provides correct blending of transparent surfaces.
-    void drawSortedBrushEntity(const ViewContext &context, ClientEntity *clent);
+    void drawSortedBrushEntity(const ViewContext &context, ClientEntity *clent,
+                               RenderCommandBuffer &cmds);
 
 private:
     struct EntData {
         glm::mat4 transformMat;
+        uint32_t uUniformsIdx = 0;
+        const Material *pMaterial = nullptr; //!< Material of the current batch
     };
 
     SceneRenderer &m_Renderer;
-    std::vector<unsigned> m_SortBuffer;
-
-    // Batching
-    GPUBuffer m_WorldEbo;
-    std::vector<uint16_t> m_WorldEboBuf;
-    unsigned m_uWorldEboOffset = 0;
-    unsigned m_uWorldEboIdx = 0;
-    Material *m_pBatchMaterial = nullptr;
-
-    void createBuffers();
+    RenderQueue m_SortQueue;
 
     //! Prepares brush model entity for rendering.
     //! @returns whether the entity was culled.
@@ -42,14 +33,11 @@ private:
     //! @returns brush model transformation materix.
     glm::mat4 getBrushTransform(const ClientEntity *clent) const;
 
-    //! Adds a surface to the current batch.
-    void batchAddSurface(const Surface &surf);
-
-    //! Issues current batch for rendering.
-    void batchFlush();
+    //! Records entity state: geometry, render mode and uniforms.
+    void beginEntity(RenderCommandBuffer &cmds, const ClientEntity *clent, EntData &entData) const;
 
-    //! Resets current batch. Pending data is discarded.
-    void batchReset();
+    //! Adds a surface to the current batch. Draws the batch if the material changes.
+    void addSurface(RenderCommandBuffer &cmds, EntData &entData, const Surface &surf) const;
 };
 
 #endif
@@ -86,10 +86,28 @@ SceneRenderer::BSPLightmap::BSPLightmap(SceneRenderer &renderer) {
 
     // Add lightmaps to bitmaps
     int failedCount = 0;
+    int invalidCount = 0;
     for (const stbrp_rect &rect : rects) {
         if (rect.was_packed) {
             SurfaceData &data = surfData[rect.id];
             const bsp::BSPFace &face = level.getFaces()[rect.id];
+            data.offset.x = rect.x + LIGHTMAP_PADDING;
+            data.offset.y = rect.y + LIGHTMAP_PADDING;
+
+            // Check that all styles are inside of the lump
+            size_t styleCount = 0;
+            while (styleCount < bsp::NUM_LIGHTSTYLES && face.nStyles[styleCount] != 255) {
+                styleCount++;
+            }
+
+            size_t lightmapSize = (size_t)data.size.x * data.size.y * sizeof(glm::u8vec3);
+
+            if (face.nLightmapOffset > level.getLightMaps().size() ||
+                styleCount * lightmapSize > level.getLightMaps().size() - face.nLightmapOffset) {
+                invalidCount++;
+                continue;
+            }
+
             const glm::u8vec3 *pixels = reinterpret_cast<const glm::u8vec3 *>(
                 level.getLightMaps().data() + face.nLightmapOffset);
 
@@ -102,9 +120,6 @@ SceneRenderer::BSPLightmap::BSPLightmap(SceneRenderer &renderer) {
                                       pixels, LIGHTMAP_PADDING);
                 pixels += data.size.x * data.size.y;
             }
-
-            data.offset.x = rect.x + LIGHTMAP_PADDING;
-            data.offset.y = rect.y + LIGHTMAP_PADDING;
         } else {
             failedCount++;
         }
@@ -114,6 +129,10 @@ SceneRenderer::BSPLightmap::BSPLightmap(SceneRenderer &renderer) {
         printw("BSP Lightmaps: {} faces failed to pack.", failedCount);
     }
 
+    if (invalidCount != 0) {
+        printw("BSP Lightmaps: {} faces have lightmaps outside of the lump.", invalidCount);
+    }
+
     // Combine bitmaps
     size_t imageArea = textureSize * textureSize;
     std::vector<glm::u8vec3> finalImage(imageArea * bsp::NUM_LIGHTSTYLES);
@@ -149,13 +168,15 @@ SceneRenderer::BSPLightmap::BSPLightmap(SceneRenderer &renderer) {
             }
 
             // Texture
-            v.texture.s = glm::dot(position, texInfo.vS);
-            v.texture.t = glm::dot(position, texInfo.vT);
-            v.texture += glm::vec2(texInfo.fSShift, texInfo.fTShift);
-            v.texture -= data.textureMins;
-            v.texture += glm::vec2(LIGHTMAP_DIVISOR / 2); // Shift by half-texel
-            v.texture += data.offset * LIGHTMAP_DIVISOR;
-            v.texture /= m_Texture.getWide() * LIGHTMAP_DIVISOR;
+            glm::vec2 texture;
+            texture.s = glm::dot(position, texInfo.vS);
+            texture.t = glm::dot(position, texInfo.vT);
+            texture += glm::vec2(texInfo.fSShift, texInfo.fTShift);
+            texture -= data.textureMins;
+            texture += glm::vec2(LIGHTMAP_DIVISOR / 2); // Shift by half-texel
+            texture += data.offset * LIGHTMAP_DIVISOR;
+            texture /= m_Texture.getWide() * LIGHTMAP_DIVISOR;
+            v.texture = glm::vec3(texture, 0); // Single page
 
             vertexBuffer.push_back(v);
         }
@@ -1,42 +1,311 @@
+#include <glm/gtc/packing.hpp>
+#include <app_base/app_base.h>
 #include <app_base/lightmap.h>
+#include <app_base/lz_block.h>
+#include <bsp/mapped_file.h>
 #include "custom_lightmap.h"
 
+// F16C is selected at runtime, so it doesn't need to be enabled for the whole build
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#define RENDERER_F16C
+#endif
+
+#if defined(RENDERER_F16C) && (defined(__GNUC__) || defined(__clang__))
+#define RENDERER_F16C_TARGET __attribute__((target("f16c")))
+#else
+#define RENDERER_F16C_TARGET
+#endif
+
+//! Reads values from a file mapped into memory.
+class SceneRenderer::CustomLightmap::MemoryReader {
+public:
+    MemoryReader(const uint8_t *data, size_t size)
+        : m_pData(data)
+        , m_uSize(size) {}
+
+    //! @returns pointer to the next size bytes and skips them.
+    const uint8_t *readBytes(size_t size) {
+        if (size > m_uSize - m_uOffset) {
+            throw std::runtime_error("Unexpected end of file");
+        }
+
+        const uint8_t *ptr = m_pData + m_uOffset;
+        m_uOffset += size;
+        return ptr;
+    }
+
+    template <typename T>
+    T read() {
+        T value;
+        memcpy(&value, readBytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+private:
+    const uint8_t *m_pData = nullptr;
+    size_t m_uSize = 0;
+    size_t m_uOffset = 0;
+};
+
+namespace {
+
+#ifdef RENDERER_F16C
+//! @returns whether the CPU and the OS support F16C instructions.
+bool isF16CSupported() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool f16c = info[2] & (1 << 29);
+    bool osxsave = info[2] & (1 << 27);
+
+    // F16C instructions use VEX encoding, the OS must save YMM registers
+    return f16c && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+#else
+    return __builtin_cpu_supports("f16c");
+#endif
+}
+
+//! Converts floats to half floats in groups of 4 using F16C.
+//! @returns number of converted floats.
+RENDERER_F16C_TARGET size_t floatsToHalfsF16C(const uint8_t *src, uint16_t *dst, size_t count) {
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128 floats = _mm_loadu_ps(reinterpret_cast<const float *>(src + i * sizeof(float)));
+        __m128i halfs = _mm_cvtps_ph(floats, _MM_FROUND_TO_NEAREST_INT);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(dst + i), halfs);
+    }
+
+    return i;
+}
+#endif
+
+//! Converts count floats to half floats. src doesn't need to be aligned.
+void floatsToHalfs(const uint8_t *src, uint16_t *dst, size_t count) {
+    size_t i = 0;
+
+#ifdef RENDERER_F16C
+    static const bool bF16CSupported = isF16CSupported();
+
+    if (bF16CSupported) {
+        i = floatsToHalfsF16C(src, dst, count);
+    }
+#endif
+
+    for (; i < count; i++) {
+        float value;
+        memcpy(&value, src + i * sizeof(float), sizeof(float));
+        dst[i] = glm::packHalf1x16(value);
+    }
+}
+
+//! Turns texture data of the file into data that can be uploaded to the GPU.
+//! RGBF32 is converted to RGB16F, other formats are kept as is.
+//! Decoding doesn't use GL and can be split into tasks.
+class LightmapTextureDecoder {
+public:
+    //! @param  data        Texture data in the file. Must stay valid until decoding is finished.
+    //! @param  dataSize    Size of the data in the file
+    //! @param  layerLuxels Number of luxels in each layer
+    //! @param  dataLayers  Number of layers stored in the file
+    //! @param  totalLayers Number of layers in the texture. Extra layers are black.
+    LightmapTextureDecoder(const uint8_t *data, size_t dataSize,
+                           LightmapFileFormat::Format format,
+                           LightmapFileFormat::Compression compression, size_t layerLuxels,
+                           int dataLayers, int totalLayers)
+        : m_pData(data)
+        , m_uDataSize(dataSize)
+        , m_Format(format)
+        , m_Compression(compression) {
+        size_t luxelSize = LightmapFileFormat::getLuxelSize(format);
+        m_uLuxelsSize = luxelSize * layerLuxels * dataLayers;
+
+        if (format == LightmapFileFormat::Format::RGBF32) {
+            // Converted to half floats
+            m_uFloatCount = 3 * layerLuxels * dataLayers;
+            m_UploadData.resize(3 * sizeof(uint16_t) * layerLuxels * totalLayers);
+        } else if (compression == LightmapFileFormat::Compression::LZ ||
+                   dataLayers != totalLayers) {
+            // Black layers need to follow the data
+            m_UploadData.resize(luxelSize * layerLuxels * totalLayers);
+        }
+    }
+
+    //! Adds decoding tasks to the taskflow.
+    void addTasks(tf::Taskflow &taskflow) {
+        tf::Task decompressTask = taskflow.emplace([this]() { decompress(); });
+        tf::Task convertTask = taskflow.for_each_index_dynamic(
+            (size_t)0, getChunkCount(), (size_t)1, [this](size_t i) { convertChunk(i); },
+            (size_t)1);
+        decompressTask.precede(convertTask);
+    }
+
+    //! Decodes the data on this thread.
+    void decode() {
+        decompress();
+
+        for (size_t i = 0; i < getChunkCount(); i++) {
+            convertChunk(i);
+        }
+    }
+
+    //! Throws the error that happened during decoding, if any.
+    void checkError() {
+        if (m_Error) {
+            std::rethrow_exception(m_Error);
+        }
+    }
+
+    //! @returns GL type of the data.
+    GLenum getInputType() const {
+        switch (m_Format) {
+        case LightmapFileFormat::Format::RGBF32:
+        case LightmapFileFormat::Format::RGB16F:
+            return GL_HALF_FLOAT;
+        case LightmapFileFormat::Format::RGB9E5:
+            return GL_UNSIGNED_INT_5_9_9_9_REV;
+        default:
+            AFW_ASSERT_REL(false);
+            return GL_NONE;
+        }
+    }
+
+    //! @returns data for texture upload.
+    const void *getUploadData() const {
+        return m_UploadData.empty() ? m_pData : m_UploadData.data();
+    }
+
+private:
+    //! Number of floats converted by one task.
+    static constexpr size_t CONVERT_CHUNK_SIZE = 256 * 1024;
+
+    const uint8_t *m_pData = nullptr;
+    size_t m_uDataSize = 0;
+    LightmapFileFormat::Format m_Format;
+    LightmapFileFormat::Compression m_Compression;
+    size_t m_uLuxelsSize = 0; //!< Uncompressed size of file data
+    size_t m_uFloatCount = 0; //!< Number of floats to convert
+    std::vector<uint8_t> m_Decompressed;
+    std::vector<uint8_t> m_UploadData; //!< Empty if data is uploaded straight from the file
+    std::exception_ptr m_Error;
+
+    size_t getChunkCount() const {
+        return (m_uFloatCount + CONVERT_CHUNK_SIZE - 1) / CONVERT_CHUNK_SIZE;
+    }
+
+    void decompress() {
+        if (m_Compression != LightmapFileFormat::Compression::LZ) {
+            if (m_Format != LightmapFileFormat::Format::RGBF32 && !m_UploadData.empty()) {
+                // Copy in front of the black layer
+                memcpy(m_UploadData.data(), m_pData, m_uLuxelsSize);
+            }
+
+            return;
+        }
+
+        try {
+            if (m_Format == LightmapFileFormat::Format::RGBF32) {
+                // Decompress before conversion
+                m_Decompressed.resize(m_uLuxelsSize);
+                lz::decompress(m_pData, m_uDataSize, m_Decompressed.data(), m_uLuxelsSize);
+                m_pData = m_Decompressed.data();
+            } else {
+                lz::decompress(m_pData, m_uDataSize, m_UploadData.data(), m_uLuxelsSize);
+            }
+        } catch (...) {
+            m_Error = std::current_exception();
+            m_uFloatCount = 0;
+        }
+    }
+
+    void convertChunk(size_t idx) {
+        size_t first = idx * CONVERT_CHUNK_SIZE;
+
+        if (first >= m_uFloatCount) {
+            // Decompression failed
+            return;
+        }
+
+        size_t count = std::min(CONVERT_CHUNK_SIZE, m_uFloatCount - first);
+        uint16_t *dst = reinterpret_cast<uint16_t *>(m_UploadData.data()) + first;
+        floatsToHalfs(m_pData + first * sizeof(float), dst, count);
+    }
+};
+
+} // namespace
+
 SceneRenderer::CustomLightmap::CustomLightmap(SceneRenderer &renderer) {
     appfw::Timer timer;
-    appfw::BinaryInputFile file(renderer.m_CustomLightmapPath);
 
-    // Magic
-    uint8_t magic[sizeof(LightmapFileFormat::MAGIC)];
-    file.readBytes(magic, sizeof(magic));
+    // The file is mapped and parsed in place
+    bsp::MappedFile mappedFile;
+    mappedFile.open(renderer.m_CustomLightmapPath);
+    MemoryReader file(mappedFile.data(), mappedFile.size());
 
-    if (memcmp(magic, LightmapFileFormat::MAGIC, sizeof(magic))) {
+    // Magic
+    if (memcmp(file.readBytes(sizeof(LightmapFileFormat::MAGIC)), LightmapFileFormat::MAGIC,
+               sizeof(LightmapFileFormat::MAGIC))) {
         throw std::runtime_error("Invalid magic");
     }
 
     // Level & lightmap info
-    uint32_t faceCount = file.readUInt32(); // Face count
+    uint32_t faceCount = file.read<uint32_t>(); // Face count
 
     if (faceCount != renderer.m_Surfaces.size()) {
         throw std::runtime_error(fmt::format("Face count mismatch: expected {}, got {}",
                                              renderer.m_Surfaces.size(), faceCount));
     }
 
-    file.readUInt32(); // Lightmap count
+    file.read<uint32_t>(); // Lightmap count
     glm::ivec2 lightmapBlockSize;
-    lightmapBlockSize.x = file.readInt32(); // Lightmap texture wide
-    lightmapBlockSize.y = file.readInt32(); // Lightmap texture tall
+    lightmapBlockSize.x = file.read<int32_t>(); // Lightmap texture wide
+    lightmapBlockSize.y = file.read<int32_t>(); // Lightmap texture tall
+    uint32_t pageCount = file.read<uint32_t>(); // Lightmap page count
 
-    LightmapFileFormat::Format format = (LightmapFileFormat::Format)file.readByte();
-    if (format != LightmapFileFormat::Format::RGBF32) {
+    LightmapFileFormat::Format format = (LightmapFileFormat::Format)file.read<uint8_t>();
+    if (LightmapFileFormat::getLuxelSize(format) == 0) {
         throw std::runtime_error("Unsupported lightmap format");
     }
 
-    LightmapFileFormat::Compression compression = (LightmapFileFormat::Compression)file.readByte();
-    if (compression != LightmapFileFormat::Compression::None) {
+    LightmapFileFormat::Compression compression =
+        (LightmapFileFormat::Compression)file.read<uint8_t>();
+    if (compression != LightmapFileFormat::Compression::None &&
+        compression != LightmapFileFormat::Compression::LZ) {
         throw std::runtime_error("Unsupported lightmap compression");
     }
 
-    readTexture(file, lightmapBlockSize);
+    uint8_t layerMask = file.read<uint8_t>(); // Populated lightstyle layers
+    int textureDepth = setupLayers(pageCount, layerMask);
+
+    // Texture data
+    size_t layerLuxels = (size_t)lightmapBlockSize.x * lightmapBlockSize.y;
+    size_t textureDataSize = LightmapFileFormat::getLuxelSize(format) * layerLuxels * m_iBlackLayer;
+    const uint8_t *textureData = nullptr;
+
+    if (compression == LightmapFileFormat::Compression::LZ) {
+        uint32_t compressedSize = file.read<uint32_t>(); // Compressed size
+        textureData = file.readBytes(compressedSize);
+        textureDataSize = compressedSize;
+    } else {
+        textureData = file.readBytes(textureDataSize);
+    }
+
+    // Decode the texture on worker threads while faces are read
+    LightmapTextureDecoder textureDecoder(textureData, textureDataSize, format, compression,
+                                          layerLuxels, m_iBlackLayer, textureDepth);
+    tf::Taskflow taskflow;
+    std::future<void> textureFuture;
+
+    if (AppBase::isBaseReady()) {
+        textureDecoder.addTasks(taskflow);
+        textureFuture = AppBase::getBaseInstance().getExecutor().run(taskflow);
+    } else {
+        textureDecoder.decode();
+    }
 
     // Face info
     std::vector<LightmapVertex> vertexBuffer;
@@ -44,38 +313,156 @@ SceneRenderer::CustomLightmap::CustomLightmap(SceneRenderer &renderer) {
     std::vector<glm::vec3> patchBuffer;
     patchBuffer.reserve(80000);
 
-    for (uint32_t i = 0; i < faceCount; i++) {
+    try {
+        readFaces(renderer, file, lightmapBlockSize, pageCount, layerMask, vertexBuffer,
+                  patchBuffer);
+    } catch (...) {
+        // Tasks reference local data
+        if (textureFuture.valid()) {
+            textureFuture.wait();
+        }
+
+        throw;
+    }
+
+    if (textureFuture.valid()) {
+        textureFuture.wait();
+    }
+
+    textureDecoder.checkError();
+
+    // Upload texture
+    GraphicsFormat texFormat = format == LightmapFileFormat::Format::RGB9E5
+                                   ? GraphicsFormat::RGB9E5
+                                   : GraphicsFormat::RGB16F;
+    m_Texture.create("SceneRenderer: custom lightmap");
+    m_Texture.setWrapMode(TextureWrapMode::Clamp);
+    m_Texture.setFilter(TextureFilter::Bilinear);
+    m_Texture.initTexture(texFormat, lightmapBlockSize.x, lightmapBlockSize.y, textureDepth, false,
+                          GL_RGB, textureDecoder.getInputType(), textureDecoder.getUploadData());
+
+    // Upload vertex buffer
+    AFW_ASSERT_REL(vertexBuffer.size() == renderer.m_uSurfaceVertexBufferSize);
+    m_VertBuffer.create(GL_ARRAY_BUFFER, "SceneRenderer: custom lightmap vertices");
+    m_VertBuffer.init(sizeof(LightmapVertex) * vertexBuffer.size(), vertexBuffer.data(),
+                      GL_STATIC_DRAW);
+
+    // Upload patch buffer
+    m_PatchVertBuffer.create(GL_ARRAY_BUFFER, "SceneRenderer: custom lightmap patches");
+    m_PatchVertBuffer.init(sizeof(glm::vec3) * patchBuffer.size(), patchBuffer.data(),
+                           GL_STATIC_DRAW);
+
+    printi("Custom lightmaps: {} ms", timer.ms());
+    printi("Custom lightmaps: block size {}x{}, {:.2f} MiB", lightmapBlockSize.x, lightmapBlockSize.y,
+           m_Texture.getMemoryUsage() / 1024.0 / 1024.0);
+    printi("Custom lightmaps: {} patch vertices, {:.2f} MiB", patchBuffer.size(),
+           patchBuffer.size() * sizeof(glm::vec3) / 1024.0 / 1024.0);
+    printi("Custom lightmaps: vertex buffer {:.1f} KiB", m_VertBuffer.getMemUsage() / 1024.0);
+}
+
+float SceneRenderer::CustomLightmap::getGamma() {
+    // Texture is in linear space
+    return 1.0f;
+}
+
+void SceneRenderer::CustomLightmap::bindTexture() {
+    m_Texture.bind();
+}
+
+void SceneRenderer::CustomLightmap::bindVertBuffer() {
+    m_VertBuffer.bind();
+}
+
+void SceneRenderer::CustomLightmap::updateFilter(bool filterEnabled) {
+    TextureFilter filter = filterEnabled ? TextureFilter::Bilinear : TextureFilter::Nearest;
+
+    if (m_Texture.getFilter() != filter) {
+        m_Texture.setFilter(filter);
+    }
+}
+
+glm::ivec4 SceneRenderer::CustomLightmap::getStyleLayers() {
+    return m_vStyleLayers;
+}
+
+int SceneRenderer::CustomLightmap::getPageLayerCount() {
+    return m_iPageLayerCount;
+}
+
+int SceneRenderer::CustomLightmap::getBlackLayer() {
+    return m_iBlackLayer;
+}
+
+int SceneRenderer::CustomLightmap::setupLayers(uint32_t pageCount, uint8_t layerMask) {
+    // Each page only has populated layers. Missing ones share a black layer after all pages.
+    int layerCount = 0;
+
+    for (int i = 0; i < bsp::NUM_LIGHTSTYLES; i++) {
+        m_vStyleLayers[i] = (layerMask & (1 << i)) ? layerCount++ : -1;
+    }
+
+    m_iPageLayerCount = layerCount;
+    m_iBlackLayer = (int)pageCount * layerCount;
+    int textureDepth = m_iBlackLayer;
+
+    if (layerCount != bsp::NUM_LIGHTSTYLES) {
+        textureDepth++;
+    }
+
+    return textureDepth;
+}
+
+void SceneRenderer::CustomLightmap::readFaces(SceneRenderer &renderer, MemoryReader &file,
+                                              glm::ivec2 lightmapBlockSize, uint32_t pageCount,
+                                              uint8_t layerMask,
+                                              std::vector<LightmapVertex> &vertexBuffer,
+                                              std::vector<glm::vec3> &patchBuffer) {
+    for (size_t i = 0; i < renderer.m_Surfaces.size(); i++) {
         Surface &surf = renderer.m_Surfaces[i];
 
-        uint32_t vertCount = file.readUInt32(); // Vertex count
+        uint32_t vertCount = file.read<uint32_t>(); // Vertex count
 
         if (vertCount != (uint32_t)surf.vertexCount) {
             throw std::runtime_error("Vertex count mismatch");
         }
 
-        glm::vec3 vI = file.readVec<glm::vec3>();           // vI
-        glm::vec3 vJ = file.readVec<glm::vec3>();           // vJ
-        glm::vec3 vPlaneOrigin = file.readVec<glm::vec3>(); // World position of (0, 0) plane coord.
-        file.readVec<glm::vec2>(); // Offset of (0, 0) to get to plane coords
-        file.readVec<glm::vec2>(); // Face size
+        glm::vec3 vI = file.read<glm::vec3>();           // vI
+        glm::vec3 vJ = file.read<glm::vec3>();           // vJ
+        glm::vec3 vPlaneOrigin = file.read<glm::vec3>(); // World position of (0, 0) plane coord.
+        file.read<glm::vec2>(); // Offset of (0, 0) to get to plane coords
+        file.read<glm::vec2>(); // Face size
 
         // Lightstyles
         glm::ivec4 lightstyles = glm::ivec4(255);
         for (int j = 0; j < bsp::NUM_LIGHTSTYLES; j++) {
-            lightstyles[j] = file.readByte();
+            lightstyles[j] = file.read<uint8_t>();
         }
 
-        bool hasLightmap = file.readByte(); // Has lightmap
+        uint8_t styleMask = file.read<uint8_t>(); // Lightstyle presence bits
+
+        for (int j = 0; j < bsp::NUM_LIGHTSTYLES; j++) {
+            if (!(styleMask & layerMask & (1 << j))) {
+                // No data for the slot, disable it
+                lightstyles[j] = 255;
+            }
+        }
+
+        bool hasLightmap = file.read<uint8_t>(); // Has lightmap
 
         if (hasLightmap) {
-            glm::ivec2 lmSize = file.readVec<glm::ivec2>(); // Lightmap size
+            glm::ivec2 lmSize = file.read<glm::ivec2>(); // Lightmap size
+            uint32_t page = file.read<uint32_t>();         // Lightmap page
+
+            if (page >= pageCount) {
+                throw std::runtime_error("Lightmap page out of range");
+            }
 
             // Lightmap tex coords
             for (uint32_t j = 0; j < vertCount; j++) {
                 LightmapVertex v;
 
-                glm::vec2 texCoords = file.readVec<glm::vec2>(); // Tex coord in luxels
-                v.texture = texCoords / glm::vec2(lightmapBlockSize);
+                glm::vec2 texCoords = file.read<glm::vec2>(); // Tex coord in luxels
+                v.texture = glm::vec3(texCoords / glm::vec2(lightmapBlockSize), page);
 
                 v.lightstyle = lightstyles;
 
@@ -83,11 +470,11 @@ SceneRenderer::CustomLightmap::CustomLightmap(SceneRenderer &renderer) {
             }
 
             // Patches
-            uint32_t patchCount = file.readUInt32(); // Patch count
+            uint32_t patchCount = file.read<uint32_t>(); // Patch count
 
             for (uint32_t j = 0; j < patchCount; j++) {
-                glm::vec2 coord = file.readVec<glm::vec2>();
-                float size = file.readFloat();
+                glm::vec2 coord = file.read<glm::vec2>();
+                float size = file.read<float>();
                 float k = size / 2.0f;
 
                 glm::vec3 org = vPlaneOrigin + coord.x * vI + coord.y * vJ;
@@ -115,56 +502,5 @@ SceneRenderer::CustomLightmap::CustomLightmap(SceneRenderer &renderer) {
             vertexBuffer.insert(vertexBuffer.end(), vertCount, LightmapVertex());
         }
     }
-
-    // Upload vertex buffer
-    AFW_ASSERT_REL(vertexBuffer.size() == renderer.m_uSurfaceVertexBufferSize);
-    m_VertBuffer.create(GL_ARRAY_BUFFER, "SceneRenderer: custom lightmap vertices");
-    m_VertBuffer.init(sizeof(LightmapVertex) * vertexBuffer.size(), vertexBuffer.data(),
-                      GL_STATIC_DRAW);
-
-    // Upload patch buffer
-    m_PatchVertBuffer.create(GL_ARRAY_BUFFER, "SceneRenderer: custom lightmap patches");
-    m_PatchVertBuffer.init(sizeof(glm::vec3) * patchBuffer.size(), patchBuffer.data(),
-                           GL_STATIC_DRAW);
-
-    printi("Custom lightmaps: {} ms", timer.ms());
-    printi("Custom lightmaps: block size {}x{}, {:.2f} MiB", lightmapBlockSize.x, lightmapBlockSize.y,
-           m_Texture.getMemoryUsage() / 1024.0 / 1024.0);
-    printi("Custom lightmaps: {} patch vertices, {:.2f} MiB", patchBuffer.size(),
-           patchBuffer.size() * sizeof(glm::vec3) / 1024.0 / 1024.0);
-    printi("Custom lightmaps: vertex buffer {:.1f} KiB", m_VertBuffer.getMemUsage() / 1024.0);
-}
-
-float SceneRenderer::CustomLightmap::getGamma() {
-    // Texture is in linear space
-    return 1.0f;
-}
-
-void SceneRenderer::CustomLightmap::bindTexture() {
-    m_Texture.bind();
-}
-
-void SceneRenderer::CustomLightmap::bindVertBuffer() {
-    m_VertBuffer.bind();
-}
-
-void SceneRenderer::CustomLightmap::updateFilter(bool filterEnabled) {
-    TextureFilter filter = filterEnabled ? TextureFilter::Bilinear : TextureFilter::Nearest;
-
-    if (m_Texture.getFilter() != filter) {
-        m_Texture.setFilter(filter);
-    }
 }
 
-void SceneRenderer::CustomLightmap::readTexture(appfw::BinaryInputFile &file, glm::ivec2 size) {
-    size_t textureBlockSize = size.x * size.y * bsp::NUM_LIGHTSTYLES;
-    std::vector<glm::vec3> lightmapTexture(textureBlockSize);
-    file.readBytes(reinterpret_cast<uint8_t *>(lightmapTexture.data()),
-                   textureBlockSize * sizeof(glm::vec3));
-
-    m_Texture.create("SceneRenderer: custom lightmap");
-    m_Texture.setWrapMode(TextureWrapMode::Clamp);
-    m_Texture.setFilter(TextureFilter::Bilinear);
-    m_Texture.initTexture(GraphicsFormat::RGB16F, size.x, size.y, bsp::NUM_LIGHTSTYLES, false,
-                          GL_RGB, GL_FLOAT, lightmapTexture.data());
-}
@@ -1,6 +1,6 @@
 #ifndef CUSTOM_LIGHTMAP_H
 #define CUSTOM_LIGHTMAP_H
-#include <appfw/binary_file.h>
+#include <app_base/lightmap.h>
 #include <graphics/texture2d_array.h>
 #include <renderer/scene_renderer.h>
 #include "lightmap_iface.h"
@@ -12,13 +12,29 @@ public:
     void bindTexture() override;
     void bindVertBuffer() override;
     void updateFilter(bool filterEnabled) override;
+    glm::ivec4 getStyleLayers() override;
+    int getPageLayerCount() override;
+    int getBlackLayer() override;
 
 private:
+    class MemoryReader;
+
     Texture2DArray m_Texture;
     GPUBuffer m_VertBuffer;
     GPUBuffer m_PatchVertBuffer;
+    glm::ivec4 m_vStyleLayers = glm::ivec4(-1);
+    int m_iPageLayerCount = 0;
+    int m_iBlackLayer = 0;
+
+    //! Sets up lightstyle layers of the texture.
+    //! @returns texture depth.
+    int setupLayers(uint32_t pageCount, uint8_t layerMask);
 
-    void readTexture(appfw::BinaryInputFile &file, glm::ivec2 size);
+    //! Reads face info into the vertex and patch buffers.
+    void readFaces(SceneRenderer &renderer, MemoryReader &file, glm::ivec2 lightmapBlockSize,
+                   uint32_t pageCount, uint8_t layerMask,
+                   std::vector<LightmapVertex> &vertexBuffer,
+                   std::vector<glm::vec3> &patchBuffer);
 };
 
 #endif
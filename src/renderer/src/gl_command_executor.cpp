@@ -0,0 +1,117 @@
+#include <renderer/renderer_engine_interface.h>
+#include <renderer/scene_shaders.h>
+#include "gl_command_executor.h"
+#include "sprite_renderer.h"
+
+SceneRenderer::GLCommandExecutor::GLCommandExecutor(SceneRenderer &renderer)
+    : m_Renderer(renderer) {}
+
+void SceneRenderer::GLCommandExecutor::execute(const RenderCommandBuffer &cmds) {
+    using CommandType = RenderCommandBuffer::CommandType;
+    m_pShaderInstance = nullptr;
+
+    for (const RenderCommandBuffer::Command &cmd : cmds) {
+        switch (cmd.type) {
+        case CommandType::BindGeometry: {
+            bindGeometry((RenderCommandBuffer::Geometry)cmd.uArg);
+            break;
+        }
+        case CommandType::SetDepthFunc: {
+            auto func = (RenderCommandBuffer::DepthFunc)cmd.uArg;
+            glDepthFunc(func == RenderCommandBuffer::DepthFunc::LessEqual ? GL_LEQUAL : GL_LESS);
+            break;
+        }
+        case CommandType::SetRenderMode: {
+            m_Renderer.setRenderMode((RenderMode)cmd.uArg);
+            break;
+        }
+        case CommandType::EnableMaterial: {
+            cmd.pMaterial->activateTextures();
+            m_pShaderInstance = cmd.pMaterial->enableShader(cmd.uArg, m_Renderer.m_uFrameCount);
+            break;
+        }
+        case CommandType::EnableWireframe: {
+            m_pShaderInstance =
+                SceneShaders::Shaders::brushWireframe.getShaderInstance(SHADER_TYPE_CUSTOM_IDX);
+            m_pShaderInstance->enable(m_Renderer.m_uFrameCount);
+            break;
+        }
+        case CommandType::SetUniforms: {
+            setUniforms((RenderCommandBuffer::UniformSet)cmd.uArg, cmds.getUniforms(cmd.uFirst));
+            break;
+        }
+        case CommandType::DrawRanges: {
+            glMultiDrawArrays(getPrimitiveMode((RenderCommandBuffer::Primitive)cmd.uArg),
+                              cmds.getRangeFirsts() + cmd.uFirst,
+                              cmds.getRangeCounts() + cmd.uFirst, (GLsizei)cmd.uCount);
+            m_Renderer.m_Stats.uDrawCalls++;
+            break;
+        }
+        case CommandType::DrawArrays: {
+            glDrawArrays(getPrimitiveMode((RenderCommandBuffer::Primitive)cmd.uArg),
+                         (GLint)cmd.uFirst, (GLsizei)cmd.uCount);
+            m_Renderer.m_Stats.uDrawCalls++;
+            break;
+        }
+        case CommandType::DrawEngineTriangles: {
+            if (cmd.uArg) {
+                m_Renderer.m_Engine.drawTransTriangles(m_Renderer.m_Stats.uDrawCalls);
+            } else {
+                m_Renderer.m_Engine.drawNormalTriangles(m_Renderer.m_Stats.uDrawCalls);
+            }
+            break;
+        }
+        }
+    }
+}
+
+void SceneRenderer::GLCommandExecutor::bindGeometry(RenderCommandBuffer::Geometry geometry) {
+    switch (geometry) {
+    case RenderCommandBuffer::Geometry::Surfaces: {
+        glBindVertexArray(m_Renderer.m_SurfaceVao);
+        break;
+    }
+    case RenderCommandBuffer::Geometry::SpriteQuad: {
+        glBindVertexArray(m_Renderer.m_pSpriteRenderer->getVao());
+        break;
+    }
+    }
+}
+
+void SceneRenderer::GLCommandExecutor::setUniforms(RenderCommandBuffer::UniformSet set,
+                                                   const RenderCommandBuffer::Uniforms &uniforms) {
+    AFW_ASSERT(m_pShaderInstance);
+
+    switch (set) {
+    case RenderCommandBuffer::UniformSet::Brush: {
+        auto &shader = m_pShaderInstance->getShader<SceneShaders::BrushShader>();
+        shader.setModelMatrix(uniforms.mModelMat);
+        shader.setRenderMode(uniforms.nRenderMode);
+        shader.setRenderFx(uniforms.flFxAmount, uniforms.vColor);
+        break;
+    }
+    case RenderCommandBuffer::UniformSet::Sprite: {
+        auto &shader = m_pShaderInstance->getShader<SceneShaders::SpriteShader>();
+        shader.setModelMatrix(uniforms.mModelMat);
+        shader.setRenderMode(uniforms.nRenderMode);
+        shader.setRenderFx(uniforms.flFxAmount, uniforms.vColor);
+        shader.setFrame(uniforms.flFrame);
+        break;
+    }
+    case RenderCommandBuffer::UniformSet::Wireframe: {
+        auto &shader = m_pShaderInstance->getShader<SceneShaders::BrushWireframeShader>();
+        shader.setColor(uniforms.vColor);
+        break;
+    }
+    }
+}
+
+GLenum SceneRenderer::GLCommandExecutor::getPrimitiveMode(RenderCommandBuffer::Primitive primitive) {
+    switch (primitive) {
+    case RenderCommandBuffer::Primitive::LineLoop:
+        return GL_LINE_LOOP;
+    case RenderCommandBuffer::Primitive::TriangleFan:
+    default:
+        return GL_TRIANGLE_FAN;
+    }
+}
@@ -0,0 +1,24 @@
+#ifndef GL_COMMAND_EXECUTOR_H
+#define GL_COMMAND_EXECUTOR_H
+#include <renderer/scene_renderer.h>
+
+//! Replays recorded render commands using OpenGL.
+class SceneRenderer::GLCommandExecutor {
+public:
+    GLCommandExecutor(SceneRenderer &renderer);
+
+    //! Executes all commands of the buffer. Must be called on the GL thread.
+    void execute(const RenderCommandBuffer &cmds);
+
+private:
+    SceneRenderer &m_Renderer;
+    ShaderInstance *m_pShaderInstance = nullptr; //!< Currently enabled shader
+
+    void bindGeometry(RenderCommandBuffer::Geometry geometry);
+    void setUniforms(RenderCommandBuffer::UniformSet set,
+                     const RenderCommandBuffer::Uniforms &uniforms);
+
+    static GLenum getPrimitiveMode(RenderCommandBuffer::Primitive primitive);
+};
+
+#endif
@@ -17,6 +17,15 @@ public:
 
     //! Updates texture filtering properties.
     virtual void updateFilter(bool filterEnabled) = 0;
+
+    //! @returns layer in a page for each lightstyle slot or -1 to use the black layer.
+    virtual glm::ivec4 getStyleLayers() { return glm::ivec4(0, 1, 2, 3); }
+
+    //! @returns number of texture array layers in one lightmap page.
+    virtual int getPageLayerCount() { return bsp::NUM_LIGHTSTYLES; }
+
+    //! @returns texture array layer that is completely black.
+    virtual int getBlackLayer() { return 0; }
 };
 
 #endif
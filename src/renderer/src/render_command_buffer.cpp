@@ -0,0 +1,58 @@
+#include <renderer/render_command_buffer.h>
+
+void RenderCommandBuffer::clear() {
+    m_Commands.clear();
+    m_Uniforms.clear();
+    m_RangeFirsts.clear();
+    m_RangeCounts.clear();
+    m_uPendingRangesStart = 0;
+}
+
+void RenderCommandBuffer::bindGeometry(Geometry geometry) {
+    addCommand(CommandType::BindGeometry, (uint32_t)geometry);
+}
+
+void RenderCommandBuffer::setDepthFunc(DepthFunc func) {
+    addCommand(CommandType::SetDepthFunc, (uint32_t)func);
+}
+
+void RenderCommandBuffer::setRenderMode(RenderMode mode) {
+    addCommand(CommandType::SetRenderMode, (uint32_t)mode);
+}
+
+void RenderCommandBuffer::enableMaterial(const Material *material, unsigned shaderType) {
+    addCommand(CommandType::EnableMaterial, shaderType, 0, 0, material);
+}
+
+void RenderCommandBuffer::enableWireframe() {
+    addCommand(CommandType::EnableWireframe);
+}
+
+uint32_t RenderCommandBuffer::addUniforms(const Uniforms &uniforms) {
+    m_Uniforms.push_back(uniforms);
+    return (uint32_t)(m_Uniforms.size() - 1);
+}
+
+void RenderCommandBuffer::setUniforms(UniformSet set, uint32_t uniformsIdx) {
+    addCommand(CommandType::SetUniforms, (uint32_t)set, uniformsIdx);
+}
+
+void RenderCommandBuffer::drawRanges(Primitive primitive) {
+    size_t count = m_RangeFirsts.size() - m_uPendingRangesStart;
+
+    if (count == 0) {
+        return;
+    }
+
+    addCommand(CommandType::DrawRanges, (uint32_t)primitive, (uint32_t)m_uPendingRangesStart,
+               (uint32_t)count);
+    m_uPendingRangesStart = m_RangeFirsts.size();
+}
+
+void RenderCommandBuffer::drawArrays(Primitive primitive, uint32_t first, uint32_t count) {
+    addCommand(CommandType::DrawArrays, (uint32_t)primitive, first, count);
+}
+
+void RenderCommandBuffer::drawEngineTriangles(bool isTrans) {
+    addCommand(CommandType::DrawEngineTriangles, isTrans ? 1 : 0);
+}
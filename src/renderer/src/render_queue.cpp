@@ -0,0 +1,87 @@
+#include <cstring>
+#include <utility>
+#include <renderer/render_queue.h>
+
+uint64_t RenderQueue::makeKey(unsigned pass, unsigned shader, unsigned material, float depth,
+                              DepthOrder order) {
+    uint32_t depthBits = floatToSortable(depth);
+
+    if (order == DepthOrder::BackToFront) {
+        depthBits = ~depthBits;
+    }
+
+    return ((uint64_t)(pass & 0xFF) << 56) | ((uint64_t)(shader & 0xFF) << 48) |
+           ((uint64_t)(material & 0xFFFF) << 32) | depthBits;
+}
+
+uint32_t RenderQueue::floatToSortable(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    // Negative values are ordered backwards, flip all bits.
+    // Positive values need the sign bit set to be above negative ones.
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+void RenderQueue::sort() {
+    size_t count = m_Items.size();
+
+    if (count < MIN_RADIX_SORT_SIZE) {
+        // Insertion sort, stable
+        for (size_t i = 1; i < count; i++) {
+            Item item = m_Items[i];
+            size_t j = i;
+
+            for (; j > 0 && m_Items[j - 1].uKey > item.uKey; j--) {
+                m_Items[j] = m_Items[j - 1];
+            }
+
+            m_Items[j] = item;
+        }
+
+        return;
+    }
+
+    // LSD radix sort, one byte per pass
+    constexpr int PASS_COUNT = sizeof(uint64_t);
+    size_t histograms[PASS_COUNT][256] = {};
+
+    for (const Item &item : m_Items) {
+        for (int pass = 0; pass < PASS_COUNT; pass++) {
+            histograms[pass][(item.uKey >> (pass * 8)) & 0xFF]++;
+        }
+    }
+
+    m_TempItems.resize(count);
+    Item *src = m_Items.data();
+    Item *dst = m_TempItems.data();
+
+    for (int pass = 0; pass < PASS_COUNT; pass++) {
+        size_t *histogram = histograms[pass];
+        int shift = pass * 8;
+
+        if (histogram[(src[0].uKey >> shift) & 0xFF] == count) {
+            // All items have the same byte
+            continue;
+        }
+
+        // Convert counts to offsets
+        size_t offset = 0;
+
+        for (int i = 0; i < 256; i++) {
+            size_t c = histogram[i];
+            histogram[i] = offset;
+            offset += c;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            dst[histogram[(src[i].uKey >> shift) & 0xFF]++] = src[i];
+        }
+
+        std::swap(src, dst);
+    }
+
+    if (src != m_Items.data()) {
+        m_Items.swap(m_TempItems);
+    }
+}
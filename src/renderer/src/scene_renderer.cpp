@@ -1,4 +1,5 @@
 #include <appfw/str_utils.h>
+#include <app_base/app_base.h>
 #include <renderer/renderer_engine_interface.h>
 #include <renderer/scene_renderer.h>
 #include <renderer/utils.h>
@@ -11,6 +12,12 @@
 #include "world_renderer.h"
 #include "brush_renderer.h"
 #include "sprite_renderer.h"
+#include "gl_command_executor.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define RENDERER_CULL_SSE
+#endif
 
 ConVar<bool> r_drawworld("r_drawworld", true, "Draw world surfaces");
 ConVar<bool> r_drawsky("r_drawsky", true, "Draw skybox");
@@ -32,6 +39,18 @@ ConVar<bool> r_patches("r_patches", false, "Draw custom lightmap patches");
 static const char *r_shading_values[] = {"Fullbright", "Shaded", "Lightmaps"};
 static const char *r_lightmap_values[] = {"BSP", "Custom"};
 
+//! @returns the point used to sort the entity by distance.
+static glm::vec3 getEntitySortOrigin(const ClientEntity *ent) {
+    Model *model = ent->pModel;
+
+    if (model->type == ModelType::Brush) {
+        glm::vec3 avg = (model->vMins + model->vMaxs) * 0.5f;
+        return ent->vOrigin + avg;
+    } else {
+        return ent->vOrigin;
+    }
+}
+
 //----------------------------------------------------------------
 // ViewContext
 //----------------------------------------------------------------
@@ -133,6 +152,43 @@ bool SceneRenderer::ViewContext::cullBox(glm::vec3 mins, glm::vec3 maxs) const {
     return false;
 }
 
+bool SceneRenderer::ViewContext::cullBox(glm::vec3 mins, glm::vec3 maxs,
+                                         unsigned &planeMask) const {
+    if (m_Cull == Cull::None) {
+        planeMask = 0;
+        return false;
+    }
+
+    for (int i = 0; i < 6; i++) {
+        if (!(planeMask & (1u << i))) {
+            continue;
+        }
+
+        const Plane &p = m_Frustum[i];
+
+        // Corners of the box that are the farthest and the nearest along the plane normal
+        glm::vec3 farCorner, nearCorner;
+
+        for (int k = 0; k < 3; k++) {
+            bool neg = p.signbits & (1 << k);
+            farCorner[k] = neg ? mins[k] : maxs[k];
+            nearCorner[k] = neg ? maxs[k] : mins[k];
+        }
+
+        if (glm::dot(p.vNormal, farCorner) < p.fDist) {
+            // Completely behind the plane
+            return true;
+        }
+
+        if (glm::dot(p.vNormal, nearCorner) >= p.fDist) {
+            // Completely in front of the plane
+            planeMask &= ~(1u << i);
+        }
+    }
+
+    return false;
+}
+
 bool SceneRenderer::ViewContext::cullSurface(const Surface &surface) const {
     if (m_Cull == Cull::None) {
         return false;
@@ -143,19 +199,19 @@ bool SceneRenderer::ViewContext::cullSurface(const Surface &surface) const {
     if (m_Cull == Cull::Back) {
         // Back face culling
         if (surface.flags & SURF_PLANEBACK) {
-            if (dist >= -BACKFACE_EPSILON)
+            if (dist >= -m_flBackfaceEpsilon)
                 return true; // wrong side
         } else {
-            if (dist <= BACKFACE_EPSILON)
+            if (dist <= m_flBackfaceEpsilon)
                 return true; // wrong side
         }
     } else if (m_Cull == Cull::Front) {
         // Front face culling
         if (surface.flags & SURF_PLANEBACK) {
-            if (dist <= BACKFACE_EPSILON)
+            if (dist <= m_flBackfaceEpsilon)
                 return true; // wrong side
         } else {
-            if (dist >= -BACKFACE_EPSILON)
+            if (dist >= -m_flBackfaceEpsilon)
                 return true; // wrong side
         }
     }
@@ -164,32 +220,213 @@ bool SceneRenderer::ViewContext::cullSurface(const Surface &surface) const {
     return cullBox(surface.vMins, surface.vMaxs);
 }
 
+void SceneRenderer::ViewContext::cullSurfaces(const SurfaceCullData &data, unsigned first,
+                                             unsigned count, uint32_t *visMask,
+                                             unsigned planeMask) const {
+    std::fill(visMask, visMask + (count + 31) / 32, 0u);
+
+    if (m_Cull == Cull::None) {
+        for (unsigned i = 0; i < count; i++) {
+            visMask[i / 32] |= 1u << (i % 32);
+        }
+
+        return;
+    }
+
+    // Corner of the box that is the farthest along the plane normal
+    const float *pvert[6][3];
+
+    for (int j = 0; j < 6; j++) {
+        for (int k = 0; k < 3; k++) {
+            bool neg = m_Frustum[j].signbits & (1 << k);
+            pvert[j][k] = (neg ? data.mins[k] : data.maxs[k]).data() + first;
+        }
+    }
+
+    const float *nx = data.normal[0].data() + first;
+    const float *ny = data.normal[1].data() + first;
+    const float *nz = data.normal[2].data() + first;
+    const float *nd = data.dist.data() + first;
+    glm::vec3 o = m_vViewOrigin;
+    bool cullBack = m_Cull == Cull::Back;
+
+#ifdef RENDERER_CULL_SSE
+    constexpr unsigned W = SurfaceCullData::SIMD_WIDTH;
+    __m128 ox = _mm_set1_ps(o.x);
+    __m128 oy = _mm_set1_ps(o.y);
+    __m128 oz = _mm_set1_ps(o.z);
+    __m128 eps = _mm_set1_ps(cullBack ? m_flBackfaceEpsilon : -m_flBackfaceEpsilon);
+
+    for (unsigned i = 0; i < count; i += W) {
+        // Back/front face culling
+        __m128 d = _mm_mul_ps(ox, _mm_loadu_ps(nx + i));
+        d = _mm_add_ps(d, _mm_mul_ps(oy, _mm_loadu_ps(ny + i)));
+        d = _mm_add_ps(d, _mm_mul_ps(oz, _mm_loadu_ps(nz + i)));
+        d = _mm_sub_ps(d, _mm_loadu_ps(nd + i));
+        __m128 culled = cullBack ? _mm_cmple_ps(d, eps) : _mm_cmpge_ps(d, eps);
+
+        // Frustum culling
+        for (int j = 0; j < 6; j++) {
+            if (!(planeMask & (1u << j))) {
+                continue;
+            }
+
+            const Plane &p = m_Frustum[j];
+            __m128 v = _mm_mul_ps(_mm_set1_ps(p.vNormal.x), _mm_loadu_ps(pvert[j][0] + i));
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(p.vNormal.y), _mm_loadu_ps(pvert[j][1] + i)));
+            v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(p.vNormal.z), _mm_loadu_ps(pvert[j][2] + i)));
+            culled = _mm_or_ps(culled, _mm_cmplt_ps(v, _mm_set1_ps(p.fDist)));
+        }
+
+        uint32_t visible = ~(uint32_t)_mm_movemask_ps(culled) & ((1u << W) - 1);
+        visMask[i / 32] |= visible << (i % 32);
+    }
+
+    // Clear bits of padding items
+    if (count % 32 != 0) {
+        visMask[count / 32] &= (1u << (count % 32)) - 1;
+    }
+#else
+    for (unsigned i = 0; i < count; i++) {
+        float d = o.x * nx[i] + o.y * ny[i] + o.z * nz[i] - nd[i];
+        bool culled = cullBack ? d <= m_flBackfaceEpsilon : d >= -m_flBackfaceEpsilon;
+
+        for (int j = 0; j < 6 && !culled; j++) {
+            if (!(planeMask & (1u << j))) {
+                continue;
+            }
+
+            const Plane &p = m_Frustum[j];
+            float v = p.vNormal.x * pvert[j][0][i] + p.vNormal.y * pvert[j][1][i] +
+                      p.vNormal.z * pvert[j][2][i];
+            culled = v < p.fDist;
+        }
+
+        if (!culled) {
+            visMask[i / 32] |= 1u << (i % 32);
+        }
+    }
+#endif
+}
+
 void SceneRenderer::ViewContext::setupFrustum() {
+    setupFrustumPlanes(0, 0);
+}
+
+bool SceneRenderer::ViewContext::setupPaddedFrustum(float flDistMargin, float flAngleMargin) {
+    // Half-angles must stay below 90 degrees
+    constexpr float MAX_HALF_FOV = 80.0f;
+    glm::vec2 planeMargins = getPlaneAngleMargins(flAngleMargin);
+
+    if (m_flHorFov / 2 + planeMargins.x > MAX_HALF_FOV ||
+        m_flVertFov / 2 + planeMargins.y > MAX_HALF_FOV) {
+        setupFrustumPlanes(0, 0);
+        return false;
+    }
+
+    setupFrustumPlanes(flDistMargin, flAngleMargin);
+    return true;
+}
+
+bool SceneRenderer::ViewContext::isWithinMargins(const ViewContext &other, float flDistMargin,
+                                                 float flAngleMargin) const {
+    if (m_Type != other.m_Type || m_Cull != other.m_Cull || m_flHorFov != other.m_flHorFov ||
+        m_flVertFov != other.m_flVertFov || m_flFarZ != other.m_flFarZ) {
+        return false;
+    }
+
+    if (glm::length2(m_vViewOrigin - other.m_vViewOrigin) > flDistMargin * flDistMargin) {
+        return false;
+    }
+
+    // Angle of rotation between the two orientations: trace(R) = 1 + 2 * cos(angle)
+    float trace = glm::dot(m_vForward, other.m_vForward) + glm::dot(m_vRight, other.m_vRight) +
+                  glm::dot(m_vUp, other.m_vUp);
+    float cosAngle = (trace - 1.0f) / 2.0f;
+    return cosAngle >= std::cos(glm::radians(flAngleMargin));
+}
+
+glm::vec2 SceneRenderer::ViewContext::getPlaneAngleMargins(float flAngleMargin) const {
+    if (flAngleMargin == 0) {
+        return glm::vec2(0, 0);
+    }
+
+    // Extra rotation to make up for float errors
+    constexpr float SLACK = 0.1f;
+
+    // A rotation by up to flAngleMargin moves a ray by up to that angle in any direction.
+    // A ray on a side plane edge at elevation phi (measured from the middle of the edge) is
+    // sin(m) * cos(phi) away from that plane rotated outwards by m. Corner rays are the closest.
+    float tanHalfHor = std::tan(glm::radians(m_flHorFov / 2));
+    float tanHalfVert = std::tan(glm::radians(m_flVertFov / 2));
+    float cosHalfHor = std::cos(glm::radians(m_flHorFov / 2));
+    float cosHalfVert = std::cos(glm::radians(m_flVertFov / 2));
+    float horEdgeElevation = std::atan(tanHalfVert * cosHalfHor);  // Left and right planes
+    float vertEdgeElevation = std::atan(tanHalfHor * cosHalfVert); // Bottom and top planes
+    float sinMargin = std::sin(glm::radians(flAngleMargin));
+
+    auto calcMargin = [&](float flEdgeElevation) {
+        float sinPlaneMargin = sinMargin / std::cos(flEdgeElevation);
+
+        if (sinPlaneMargin >= 1.0f) {
+            // Can't be padded
+            return 90.0f;
+        }
+
+        return glm::degrees(std::asin(sinPlaneMargin)) + SLACK;
+    };
+
+    return glm::vec2(calcMargin(horEdgeElevation), calcMargin(vertEdgeElevation));
+}
+
+void SceneRenderer::ViewContext::setupFrustumPlanes(float flDistMargin, float flAngleMargin) {
     // Build the transformation matrix for the given view angles
     angleVectors(m_vViewAngles, &m_vForward, &m_vRight, &m_vUp);
 
+    glm::vec2 planeMargins = getPlaneAngleMargins(flAngleMargin);
+    float halfHorFov = m_flHorFov / 2 + planeMargins.x;
+    float halfVertFov = m_flVertFov / 2 + planeMargins.y;
+    glm::vec3 origin = m_vViewOrigin;
+
+    if (flDistMargin > 0) {
+        // Move the apex back so that the widened frustum contains a sphere of radius
+        // flDistMargin around the view origin, and so all frustums with origins inside of it.
+        float minHalfFov = glm::radians(std::min(halfHorFov, halfVertFov));
+        origin -= m_vForward * (flDistMargin / std::sin(minHalfFov));
+    }
+
     // Setup frustum
     // rotate m_vForward right by FOV_X/2 degrees
-    m_Frustum[0].vNormal = rotatePointAroundVector(m_vUp, m_vForward, -(90 - m_flHorFov / 2));
+    m_Frustum[0].vNormal = rotatePointAroundVector(m_vUp, m_vForward, -(90 - halfHorFov));
     // rotate m_vForward left by FOV_X/2 degrees
-    m_Frustum[1].vNormal = rotatePointAroundVector(m_vUp, m_vForward, 90 - m_flHorFov / 2);
+    m_Frustum[1].vNormal = rotatePointAroundVector(m_vUp, m_vForward, 90 - halfHorFov);
     // rotate m_vForward up by FOV_Y/2 degrees
-    m_Frustum[2].vNormal = rotatePointAroundVector(m_vRight, m_vForward, 90 - m_flVertFov / 2);
+    m_Frustum[2].vNormal = rotatePointAroundVector(m_vRight, m_vForward, 90 - halfVertFov);
     // rotate m_vForward down by FOV_Y/2 degrees
-    m_Frustum[3].vNormal = rotatePointAroundVector(m_vRight, m_vForward, -(90 - m_flVertFov / 2));
+    m_Frustum[3].vNormal = rotatePointAroundVector(m_vRight, m_vForward, -(90 - halfVertFov));
     // near clipping plane
     m_Frustum[4].vNormal = m_vForward;
 
     for (size_t i = 0; i < 5; i++) {
-        m_Frustum[i].fDist = glm::dot(m_vViewOrigin, m_Frustum[i].vNormal);
+        m_Frustum[i].fDist = glm::dot(origin, m_Frustum[i].vNormal);
         m_Frustum[i].signbits = signbitsForPlane(m_Frustum[i].vNormal);
     }
 
     // Far clipping plane
-    glm::vec3 farPoint = vectorMA(m_vViewOrigin, m_flFarZ, m_vForward);
     m_Frustum[5].vNormal = -m_vForward;
-    m_Frustum[5].fDist = glm::dot(farPoint, m_Frustum[5].vNormal);
+
+    if (flDistMargin == 0 && flAngleMargin == 0) {
+        glm::vec3 farPoint = vectorMA(m_vViewOrigin, m_flFarZ, m_vForward);
+        m_Frustum[5].fDist = glm::dot(farPoint, m_Frustum[5].vNormal);
+    } else {
+        // Rotated far planes are not contained by any plane. Everything is in front of it.
+        m_Frustum[5].fDist = std::numeric_limits<float>::lowest();
+    }
+
     m_Frustum[5].signbits = signbitsForPlane(m_Frustum[5].vNormal);
+
+    // Surfaces may turn to the view when origin moves
+    m_flBackfaceEpsilon = BACKFACE_EPSILON - flDistMargin;
 }
 
 //----------------------------------------------------------------
@@ -207,6 +444,7 @@ SceneRenderer::SceneRenderer(bsp::Level &level, std::string_view path, IRenderer
     m_pWorldRenderer = std::make_unique<WorldRenderer>(*this);
     m_pBrushRenderer = std::make_unique<BrushRenderer>(*this);
     m_pSpriteRenderer = std::make_unique<SpriteRenderer>(*this);
+    m_pCommandExecutor = std::make_unique<GLCommandExecutor>(*this);
 }
 
 SceneRenderer::~SceneRenderer() {
@@ -217,18 +455,58 @@ void SceneRenderer::setViewportSize(const glm::ivec2 &size) {
     m_vTargetViewportSize = size;
 }
 
+void SceneRenderer::prepareScene() {
+    m_Stats = RenderingStats();
+    m_ViewContext.setupFrustum();
+
+    if (r_drawworld.getValue()) {
+        m_pWorldRenderer->getTexturedWorldSurfaces(m_ViewContext,
+                                                   m_pWorldRenderer->m_MainWorldSurfList);
+    }
+
+    if (r_drawents.getValue()) {
+        sortSolidEntities();
+        sortTransEntities();
+    }
+
+    recordCommands();
+    m_bIsScenePrepared = true;
+}
+
+void SceneRenderer::prepareScenes(appfw::span<SceneRenderer *const> renderers) {
+    if (renderers.size() < 2 || !AppBase::isBaseReady()) {
+        for (SceneRenderer *pRenderer : renderers) {
+            pRenderer->prepareScene();
+        }
+
+        return;
+    }
+
+    tf::Taskflow taskflow;
+    taskflow.for_each_index_dynamic((size_t)0, renderers.size(), (size_t)1,
+                                    [&](size_t i) { renderers[i]->prepareScene(); }, (size_t)1);
+    AppBase::getBaseInstance().getExecutor().run(taskflow).wait();
+}
+
 void SceneRenderer::renderScene(GLint targetFb, float flSimTime, float flTimeDelta) {
     appfw::Timer renderTimer;
     appfw::Prof prof("Render Scene");
-    
-    m_Stats = RenderingStats();
     m_uFrameCount++;
 
+    if (!m_bIsScenePrepared) {
+        appfw::Prof prof("Prepare Scene");
+        prepareScene();
+    }
+
     validateSettings();
     frameSetup(flSimTime, flTimeDelta);
     viewRenderingSetup();
-    drawWorld();
-    drawEntities();
+
+    {
+        appfw::Prof prof("Execute Commands");
+        m_pCommandExecutor->execute(m_CommandBuffer);
+    }
+
     viewRenderingEnd();
 
     glBindFramebuffer(GL_FRAMEBUFFER, targetFb);
@@ -236,6 +514,7 @@ void SceneRenderer::renderScene(GLint targetFb, float flSimTime, float flTimeDel
 
     frameEnd();
 
+    m_bIsScenePrepared = false;
     m_Stats.flFrameTime = renderTimer.dseconds();
 }
 
@@ -256,7 +535,7 @@ void SceneRenderer::showDebugDialog(const char *title, bool *isVisible) {
                     m_Stats.uWorldPolys, m_Stats.uSkyPolys);
         ImGui::Text("Brush ent surfs: %u", m_Stats.uBrushEntPolys);
         ImGui::Text("Draw calls: %u", m_Stats.uDrawCalls);
-        ImGui::Text("EBO overflows: %u", m_Stats.uEboOverflows);
+        ImGui::Text("Commands: %u", m_Stats.uCommands);
         ImGui::Separator();
 
         ImGui::Text("Entities: %u", m_uVisibleEntCount);
@@ -315,6 +594,7 @@ void SceneRenderer::clearEntities() {
     m_SolidEntityList.clear();
     m_TransEntityList.clear();
     m_uVisibleEntCount = 0;
+    m_bIsScenePrepared = false;
 }
 
 bool SceneRenderer::addEntity(ClientEntity *pClent) {
@@ -330,6 +610,7 @@ bool SceneRenderer::addEntity(ClientEntity *pClent) {
         m_TransEntityList.push_back(pClent);
     }
     m_uVisibleEntCount++;
+    m_bIsScenePrepared = false;
     return true;
 }
 
@@ -337,6 +618,10 @@ Material *SceneRenderer::getSurfaceMaterial(int surface) {
     return m_Surfaces[surface].material;
 }
 
+void SceneRenderer::setStaticBrushModels(appfw::span<const Model *const> models) {
+    m_pWorldRenderer->setStaticModels(models);
+}
+
 #ifdef RENDERER_SUPPORT_TINTING
 void SceneRenderer::setSurfaceTint(int surface, glm::vec4 color) {
     Surface &surf = m_Surfaces[surface];
@@ -353,9 +638,6 @@ void SceneRenderer::setSurfaceTint(int surface, glm::vec4 color) {
 
 void SceneRenderer::initSurfaces() {
     auto &lvlFaces = m_Level.getFaces();
-    auto &lvlSurfEdges = m_Level.getSurfEdges();
-    auto &lvlEdges = m_Level.getEdges();
-    auto &lvlVertices = m_Level.getVertices();
     m_Surfaces.resize(lvlFaces.size());
 
     for (size_t i = 0; i < m_Surfaces.size(); i++) {
@@ -374,25 +656,16 @@ void SceneRenderer::initSurfaces() {
         surface.vMaxs = glm::vec3(-999999.0f);
         surface.vOrigin = glm::vec3(0, 0, 0);
 
-        for (int j = 0; j < face.nEdges; j++) {
-            if (j == MAX_SIDE_VERTS) {
-                printw("Surface {} is too large (exceeded {} vertices)", j, MAX_SIDE_VERTS);
-                break;
-            }
+        appfw::span<const glm::vec3> faceVertices = m_Level.getFaceVertices(i);
 
-            glm::vec3 vertex;
-            bsp::BSPSurfEdge iEdgeIdx = lvlSurfEdges.at((size_t)face.iFirstEdge + j);
-
-            if (iEdgeIdx > 0) {
-                const bsp::BSPEdge &edge = lvlEdges.at(iEdgeIdx);
-                vertex = lvlVertices.at(edge.iVertex[0]);
-            } else {
-                const bsp::BSPEdge &edge = lvlEdges.at(-iEdgeIdx);
-                vertex = lvlVertices.at(edge.iVertex[1]);
-            }
+        if (faceVertices.size() > MAX_SIDE_VERTS) {
+            printw("Surface {} is too large (exceeded {} vertices)", i, MAX_SIDE_VERTS);
+            faceVertices = faceVertices.subspan(0, MAX_SIDE_VERTS);
+        }
 
-            surface.faceVertices.push_back(vertex);
+        surface.faceVertices.assign(faceVertices.begin(), faceVertices.end());
 
+        for (glm::vec3 vertex : faceVertices) {
             // Add vertex to bounds
             for (int k = 0; k < 3; k++) {
                 float val = vertex[k];
@@ -408,7 +681,6 @@ void SceneRenderer::initSurfaces() {
             surface.vOrigin += vertex;
         }
 
-        surface.faceVertices.shrink_to_fit();
         surface.vOrigin /= (float)surface.faceVertices.size();
 
         // Find material
@@ -425,6 +697,40 @@ void SceneRenderer::initSurfaces() {
 
         surface.color = glm::vec3(rand() % 256, rand() % 256, rand() % 256) / 255.0f;
     }
+
+    initSurfaceCullData();
+}
+
+void SceneRenderer::initSurfaceCullData() {
+    SurfaceCullData &data = m_SurfaceCullData;
+    size_t size = m_Surfaces.size() + SurfaceCullData::SIMD_WIDTH;
+
+    for (int k = 0; k < 3; k++) {
+        data.mins[k].assign(size, 0.0f);
+        data.maxs[k].assign(size, 0.0f);
+        data.normal[k].assign(size, 0.0f);
+    }
+
+    data.dist.assign(size, 0.0f);
+
+    for (size_t i = 0; i < m_Surfaces.size(); i++) {
+        const Surface &surface = m_Surfaces[i];
+        glm::vec3 normal = surface.plane->vNormal;
+        float dist = surface.plane->fDist;
+
+        if (surface.flags & SURF_PLANEBACK) {
+            normal = -normal;
+            dist = -dist;
+        }
+
+        for (int k = 0; k < 3; k++) {
+            data.mins[k][i] = surface.vMins[k];
+            data.maxs[k][i] = surface.vMaxs[k];
+            data.normal[k][i] = normal[k];
+        }
+
+        data.dist[i] = dist;
+    }
 }
 
 void SceneRenderer::createGlobalUniform() {
@@ -444,7 +750,6 @@ void SceneRenderer::createLightstyleBuffer() {
 }
 
 void SceneRenderer::createSurfaceBuffers() {
-    AFW_ASSERT(m_uMaxEboSize == 0);
     std::vector<SurfaceVertex> vertexBuffer;
     vertexBuffer.reserve(bsp::MAX_MAP_VERTS);
     
@@ -453,7 +758,6 @@ void SceneRenderer::createSurfaceBuffers() {
 
         surf.vertexOffset = (int)vertexBuffer.size();
         surf.vertexCount = (int)surf.faceVertices.size();
-        m_uMaxEboSize += surf.vertexCount + 1;
 
         glm::vec3 normal = surf.plane->vNormal;
         if (surf.flags & SURF_PLANEBACK) {
@@ -483,12 +787,6 @@ void SceneRenderer::createSurfaceBuffers() {
         }
     }
 
-    if (vertexBuffer.size() > MAX_SURF_VERTEX_COUNT) {
-        printe("Surface vertex limit of {} reached. There are {} vertices.", MAX_SURF_VERTEX_COUNT,
-               vertexBuffer.size());
-        throw std::runtime_error("vertex limit reached");
-    }
-
     // Upload
     int64_t surfaceBuffersSize = 0;
     m_SurfaceVertexBuffer.create(GL_ARRAY_BUFFER, "SceneRenderer: Surface vertices");
@@ -637,7 +935,7 @@ void SceneRenderer::updateSurfaceVao() {
     glEnableVertexAttribArray(4);
     glVertexAttribIPointer(3, 4, GL_INT, sizeof(LightmapVertex),
                            reinterpret_cast<void *>(offsetof(LightmapVertex, lightstyle)));
-    glVertexAttribPointer(4, 2, GL_FLOAT, false, sizeof(LightmapVertex),
+    glVertexAttribPointer(4, 3, GL_FLOAT, false, sizeof(LightmapVertex),
                           reinterpret_cast<void *>(offsetof(LightmapVertex, texture)));
 
 #ifdef RENDERER_SUPPORT_TINTING
@@ -657,10 +955,6 @@ void SceneRenderer::frameSetup(float flSimTime, float flTimeDelta) {
     // Seamless cubemap filtering
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-    // Primitive restart
-    glPrimitiveRestartIndex(PRIMITIVE_RESTART_IDX);
-    glEnable(GL_PRIMITIVE_RESTART);
-
     // Fill global uniform object
     m_GlobalUniform.mMainProj = m_ViewContext.getProjectionMatrix();
     m_GlobalUniform.mMainView = m_ViewContext.getViewMatrix();
@@ -672,6 +966,9 @@ void SceneRenderer::frameSetup(float flSimTime, float flTimeDelta) {
     m_GlobalUniform.viParams1.x = r_texture.getValue();
     m_GlobalUniform.viParams1.y = r_shading.getValue();
     m_GlobalUniform.vflParams2.x = m_pCurrentLightmap->getGamma();
+    m_GlobalUniform.viParams1.z = m_pCurrentLightmap->getPageLayerCount();
+    m_GlobalUniform.viParams1.w = m_pCurrentLightmap->getBlackLayer();
+    m_GlobalUniform.viLMLayers = m_pCurrentLightmap->getStyleLayers();
 
     // Upload it to the GPU
     m_GlobalUniformBuffer.bind();
@@ -680,14 +977,10 @@ void SceneRenderer::frameSetup(float flSimTime, float flTimeDelta) {
 
     // Upload lightstyles
     m_LightstyleBuffer.update(0, sizeof(m_flLightstyleScales), m_flLightstyleScales);
-
-    // Setup main view context
-    m_ViewContext.setupFrustum();
 }
 
 void SceneRenderer::frameEnd() {
     glBindBufferBase(GL_UNIFORM_BUFFER, GLOBAL_UNIFORM_BIND, 0);
-    glDisable(GL_PRIMITIVE_RESTART);
     glDisable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 }
 
@@ -725,150 +1018,139 @@ void SceneRenderer::viewRenderingEnd() {
     glDepthFunc(GL_LESS); // In case it was changed and wasn't changed back
 }
 
-void SceneRenderer::drawWorld() {
+void SceneRenderer::recordCommands() {
+    m_CommandBuffer.clear();
+    recordWorld();
+    recordEntities();
+    m_Stats.uCommands = (unsigned)m_CommandBuffer.size();
+}
+
+void SceneRenderer::recordWorld() {
     if (!r_drawworld.getValue()) {
         return;
     }
 
-    {
-        appfw::Prof prof("World BSP");
-        m_pWorldRenderer->getTexturedWorldSurfaces(m_ViewContext,
-                                                   m_pWorldRenderer->m_MainWorldSurfList);
-    }
-
-    appfw::Prof prof("World Draw");
-    m_pWorldRenderer->drawTexturedWorld(m_pWorldRenderer->m_MainWorldSurfList);
+    auto &surfList = m_pWorldRenderer->m_MainWorldSurfList;
+    m_pWorldRenderer->drawTexturedWorld(surfList, m_CommandBuffer);
 
     if (r_drawsky.getValue()) {
-        m_pWorldRenderer->drawSkybox(m_pWorldRenderer->m_MainWorldSurfList);
+        m_pWorldRenderer->drawSkybox(surfList, m_CommandBuffer);
     }
 
     if (r_wireframe.getValue()) {
-        m_pWorldRenderer->drawWireframe(m_pWorldRenderer->m_MainWorldSurfList,
-                                        r_drawsky.getValue());
+        m_pWorldRenderer->drawWireframe(surfList, r_drawsky.getValue(), m_CommandBuffer);
     }
 }
 
-void SceneRenderer::drawEntities() {
+void SceneRenderer::recordEntities() {
     if (!r_drawents.getValue()) {
         return;
     }
 
-    appfw::Prof prof("Entities");
-    drawSolidEntities();
-    drawTransEntities();
+    recordSolidEntities();
+    recordTransEntities();
 }
 
-void SceneRenderer::drawSolidEntities() {
-    appfw::Prof prof("Solid");
-    m_pBrushRenderer->beginRendering();
+void SceneRenderer::sortSolidEntities() {
+    // Group opaque entities by model type to switch shaders less often, then by render mode.
+    // Draw near ones first.
+    m_EntityQueue.clear();
+
+    for (size_t i = 0; i < m_SolidEntityList.size(); i++) {
+        ClientEntity *pClent = m_SolidEntityList[i];
+        float dist = glm::length2(getEntitySortOrigin(pClent) - m_ViewContext.getViewOrigin());
+        uint64_t key =
+            RenderQueue::makeKey((unsigned)pClent->pModel->type, pClent->getRenderModeRank(), 0,
+                                 dist, RenderQueue::DepthOrder::FrontToBack);
+        m_EntityQueue.add(key, (uint32_t)i);
+    }
 
-    // Sort opaque entities
-    auto sortFn = [this](ClientEntity *const &lhs, ClientEntity *const &rhs) {
-        // Sort by model type
-        int lhsmodel = (int)lhs->pModel->type;
-        int rhsmodel = (int)rhs->pModel->type;
+    m_EntityQueue.sort();
+    applyEntityQueue(m_SolidEntityList);
+}
 
-        if (lhsmodel > rhsmodel) {
-            return false;
-        } else if (lhsmodel < rhsmodel) {
-            return true;
-        }
+void SceneRenderer::sortTransEntities() {
+    if (r_nosort.getValue()) {
+        return;
+    }
 
-        // Sort by render mode
-        return lhs->getRenderModeRank() < lhs->getRenderModeRank();
-    };
+    // Sort entities based on render mode and distance
+    m_EntityQueue.clear();
+
+    for (size_t i = 0; i < m_TransEntityList.size(); i++) {
+        ClientEntity *pClent = m_TransEntityList[i];
+        float dist = glm::length2(getEntitySortOrigin(pClent) - m_ViewContext.getViewOrigin());
+        uint64_t key = RenderQueue::makeKey(pClent->getRenderModeRank(), 0, 0, dist,
+                                            RenderQueue::DepthOrder::BackToFront);
+        m_EntityQueue.add(key, (uint32_t)i);
+    }
+
+    m_EntityQueue.sort();
+    applyEntityQueue(m_TransEntityList);
+}
 
-    std::sort(m_SolidEntityList.begin(), m_SolidEntityList.end(), sortFn);
+void SceneRenderer::applyEntityQueue(std::vector<ClientEntity *> &list) {
+    m_EntitySortBuffer.clear();
 
+    for (const RenderQueue::Item &item : m_EntityQueue) {
+        m_EntitySortBuffer.push_back(list[item.uIndex]);
+    }
+
+    list.swap(m_EntitySortBuffer);
+}
+
+void SceneRenderer::recordSolidEntities() {
     for (ClientEntity *pClent : m_SolidEntityList) {
         switch (pClent->pModel->type) {
         case ModelType::Brush: {
-            m_pBrushRenderer->drawBrushEntity(m_ViewContext, pClent);
+            m_pBrushRenderer->drawBrushEntity(m_ViewContext, pClent, m_CommandBuffer);
             break;
         }
         case ModelType::Sprite: {
-            m_pSpriteRenderer->drawSpriteEntity(m_ViewContext, pClent);
+            m_pSpriteRenderer->drawSpriteEntity(m_ViewContext, pClent, m_CommandBuffer);
             break;
         }
         }
     }
 
-    setRenderMode(kRenderNormal);
-    m_Engine.drawNormalTriangles(m_Stats.uDrawCalls);
+    m_CommandBuffer.setRenderMode(kRenderNormal);
+    m_CommandBuffer.drawEngineTriangles(false);
 
-    setRenderMode(kRenderNormal);
+    m_CommandBuffer.setRenderMode(kRenderNormal);
 }
 
-void SceneRenderer::drawTransEntities() {
-    appfw::Prof prof("Trans");
-    m_pBrushRenderer->beginRendering();
-
-    if (!r_nosort.getValue()) {
-        // Sort entities based on render mode and distance
-        auto sortFn = [this](ClientEntity *const &lhs, ClientEntity *const &rhs) {
-            // Sort by render mode
-            int lhsRank = lhs->getRenderModeRank();
-            int rhsRank = lhs->getRenderModeRank();
-
-            if (lhsRank > rhsRank) {
-                return false;
-            } else if (lhsRank < rhsRank) {
-                return true;
-            }
-
-            // Sort by distance
-            auto fnGetOrigin = [](const ClientEntity *ent) {
-                Model *model = ent->pModel;
-                if (model->type == ModelType::Brush) {
-                    glm::vec3 avg = (model->vMins + model->vMaxs) * 0.5f;
-                    return ent->vOrigin + avg;
-                } else {
-                    return ent->vOrigin;
-                }
-            };
-
-            glm::vec3 org1 = fnGetOrigin(lhs) - m_ViewContext.getViewOrigin();
-            glm::vec3 org2 = fnGetOrigin(rhs) - m_ViewContext.getViewOrigin();
-            float dist1 = glm::length2(org1);
-            float dist2 = glm::length2(org2);
-
-            return dist1 > dist2;
-        };
-
-        std::sort(m_TransEntityList.begin(), m_TransEntityList.end(), sortFn);
-    }
-
+void SceneRenderer::recordTransEntities() {
     for (ClientEntity *pClent : m_TransEntityList) {
         switch (pClent->pModel->type) {
         case ModelType::Brush: {
             if (r_nosort.getValue()) {
                 // Draw unsorted
-                m_pBrushRenderer->drawBrushEntity(m_ViewContext, pClent);
+                m_pBrushRenderer->drawBrushEntity(m_ViewContext, pClent, m_CommandBuffer);
             } else {
                 // Whether to sort depends on render mode
                 switch (pClent->iRenderMode) {
                 case kRenderTransTexture:
                 case kRenderTransAdd:
-                    m_pBrushRenderer->drawSortedBrushEntity(m_ViewContext, pClent);
+                    m_pBrushRenderer->drawSortedBrushEntity(m_ViewContext, pClent,
+                                                            m_CommandBuffer);
                     break;
                 default:
-                    m_pBrushRenderer->drawBrushEntity(m_ViewContext, pClent);
+                    m_pBrushRenderer->drawBrushEntity(m_ViewContext, pClent, m_CommandBuffer);
                 }
             }
             break;
         }
         case ModelType::Sprite: {
-            m_pSpriteRenderer->drawSpriteEntity(m_ViewContext, pClent);
+            m_pSpriteRenderer->drawSpriteEntity(m_ViewContext, pClent, m_CommandBuffer);
             break;
         }
         }
     }
 
-    setRenderMode(kRenderNormal);
-    m_Engine.drawTransTriangles(m_Stats.uDrawCalls);
+    m_CommandBuffer.setRenderMode(kRenderNormal);
+    m_CommandBuffer.drawEngineTriangles(true);
 
-    setRenderMode(kRenderNormal);
+    m_CommandBuffer.setRenderMode(kRenderNormal);
 }
 
 void SceneRenderer::postProcessBlit() {
@@ -10,7 +10,8 @@ SceneRenderer::SpriteRenderer::SpriteRenderer(SceneRenderer &renderer)
 }
 
 void SceneRenderer::SpriteRenderer::drawSpriteEntity(const ViewContext &context,
-                                                     ClientEntity *clent) {
+                                                     ClientEntity *clent,
+                                                     RenderCommandBuffer &cmds) {
     SpriteModel &model = static_cast<SpriteModel &>(*clent->pModel);
     glm::vec3 spriteScale =
         glm::vec3(1, model.spriteInfo.width, model.spriteInfo.height) * clent->flScale;
@@ -55,17 +56,18 @@ void SceneRenderer::SpriteRenderer::drawSpriteEntity(const ViewContext &context,
     transform = getEntityTransform(clent->vOrigin, angles) * transform;
 
     // Draw the sprite
-    glBindVertexArray(m_SpriteVao);
-    m_Renderer.setRenderMode(clent->iRenderMode);
-    Material &mat = *model.spriteMat;
-    mat.activateTextures();
-    auto &shader = mat.enableShader(SHADER_TYPE_CUSTOM_IDX, m_Renderer.m_uFrameCount)
-                       ->getShader<SceneShaders::SpriteShader>();
-    shader.setModelMatrix(transform);
-    shader.setRenderMode(clent->iRenderMode);
-    shader.setRenderFx(clent->iFxAmount / 255.0f, glm::vec3(clent->vFxColor) / 255.0f);
-    shader.setFrame(clent->flFrame);
-    glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+    RenderCommandBuffer::Uniforms uniforms;
+    uniforms.mModelMat = transform;
+    uniforms.nRenderMode = clent->iRenderMode;
+    uniforms.flFxAmount = clent->iFxAmount / 255.0f;
+    uniforms.vColor = glm::vec3(clent->vFxColor) / 255.0f;
+    uniforms.flFrame = clent->flFrame;
+
+    cmds.bindGeometry(RenderCommandBuffer::Geometry::SpriteQuad);
+    cmds.setRenderMode(clent->iRenderMode);
+    cmds.enableMaterial(model.spriteMat.get(), SHADER_TYPE_CUSTOM_IDX);
+    cmds.setUniforms(RenderCommandBuffer::UniformSet::Sprite, cmds.addUniforms(uniforms));
+    cmds.drawArrays(RenderCommandBuffer::Primitive::TriangleFan, 0, 4);
 }
 
 void SceneRenderer::SpriteRenderer::createSpriteVbo() {
@@ -6,8 +6,12 @@ class SceneRenderer::SpriteRenderer {
 public:
     SpriteRenderer(SceneRenderer &renderer);
 
-    //! Draws the sprite
-    void drawSpriteEntity(const ViewContext &context, ClientEntity *clent);
+    //! Records commands that draw the sprite.
+    void drawSpriteEntity(const ViewContext &context, ClientEntity *clent,
+                          RenderCommandBuffer &cmds);
+
+    //! @returns the VAO of the sprite quad.
+    inline const GLVao &getVao() const { return m_SpriteVao; }
 
 private:
     struct SpriteVertex {
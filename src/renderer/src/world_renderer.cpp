@@ -2,15 +2,18 @@
 #include <renderer/scene_shaders.h>
 #include "world_renderer.h"
 
+extern ConVar<bool> r_drawents;
+
 ConVar<bool> r_lockpvs("r_lockpvs", false, "Lock current PVS to let devs see where it ends");
 ConVar<bool> r_novis("r_novis", false, "Ignore visibility data");
+ConVar<bool> r_reuseworld("r_reuseworld", true,
+                          "Reuse visible world surfaces while the view moves a little");
 
 SceneRenderer::WorldRenderer::WorldRenderer(SceneRenderer &renderer)
 	: m_Renderer(renderer) {
     createLeaves();
     createNodes();
     updateNodeParents(0, 0);
-    createBuffers();
 }
 
 void SceneRenderer::WorldRenderer::getTexturedWorldSurfaces(ViewContext &context,
@@ -21,29 +24,50 @@ void SceneRenderer::WorldRenderer::getTexturedWorldSurfaces(ViewContext &context
         surfList.visFrame++;
     }
 
+    markLeaves(context, surfList);
+
+    if (surfList.bIsReusable && r_reuseworld.getValue() &&
+        surfList.reuseVisFrame == surfList.visFrame &&
+        surfList.reuseMaterialCount == m_Renderer.m_uNextMaterialIndex &&
+        surfList.bHasStaticModels == r_drawents.getValue() &&
+        context.isWithinMargins(surfList.reuseContext, REUSE_DIST_MARGIN, REUSE_ANGLE_MARGIN)) {
+        // Lists already contain all surfaces visible from the view
+        return;
+    }
+
     // Prepare surf list
     surfList.textureChainFrame++;
     surfList.textureChain.resize(m_Renderer.m_uNextMaterialIndex);
     surfList.textureChainFrames.resize(m_Renderer.m_uNextMaterialIndex);
     surfList.skySurfaces.clear();
+    surfList.bIsReusable = false;
+    surfList.bHasStaticModels = r_drawents.getValue(); // They are entities for the user
+
+    if (r_reuseworld.getValue() && context.getProjType() == ViewContext::ProjType::Perspective) {
+        surfList.reuseContext = context;
+
+        if (surfList.reuseContext.setupPaddedFrustum(REUSE_DIST_MARGIN, REUSE_ANGLE_MARGIN)) {
+            traverseWorldNodesTextured(surfList.reuseContext, surfList);
+            surfList.bIsReusable = true;
+            surfList.reuseVisFrame = surfList.visFrame;
+            surfList.reuseMaterialCount = m_Renderer.m_uNextMaterialIndex;
+            return;
+        }
+    }
 
-    markLeaves(context, surfList);
-    recursiveWorldNodesTextured(context, surfList, 0);
+    traverseWorldNodesTextured(context, surfList);
 }
 
-void SceneRenderer::WorldRenderer::drawTexturedWorld(WorldSurfaceList &surfList) {
+void SceneRenderer::WorldRenderer::drawTexturedWorld(WorldSurfaceList &surfList,
+                                                     RenderCommandBuffer &cmds) {
     auto &textureChain = surfList.textureChain;
     auto &textureChainFrames = surfList.textureChainFrames;
     unsigned frame = surfList.textureChainFrame;
     unsigned drawnSurfs = 0;
 
-    // Set up GL
-    glBindVertexArray(m_Renderer.m_SurfaceVao);
-    m_WorldEbo.bind();
+    cmds.bindGeometry(RenderCommandBuffer::Geometry::Surfaces);
 
     // Draw texture chains
-    unsigned eboIdx = 0;
-
     for (size_t i = 0; i < textureChain.size(); i++) {
         if (textureChainFrames[i] != frame) {
             continue;
@@ -51,162 +75,93 @@ void SceneRenderer::WorldRenderer::drawTexturedWorld(WorldSurfaceList &surfList)
 
         // Bind material
         const Material *mat = m_Renderer.m_Surfaces[textureChain[i][0]].material;
-        mat->activateTextures();
-        mat->enableShader(SHADER_TYPE_WORLD_IDX, m_Renderer.m_uFrameCount);
-
-        // Fill the EBO
-        unsigned eboOffset = eboIdx;
-        unsigned vertexCount = 0;
-        for (unsigned surfIdx : textureChain[i]) {
-            Surface &surf = m_Renderer.m_Surfaces[surfIdx];
-            uint16_t vertCount = (uint16_t)surf.vertexCount;
-
-            for (uint16_t j = 0; j < vertCount; j++) {
-                m_WorldEboBuf[eboIdx + j] = (uint16_t)surf.vertexOffset + j;
-            }
+        cmds.enableMaterial(mat, SHADER_TYPE_WORLD_IDX);
 
-            eboIdx += vertCount;
-            m_WorldEboBuf[eboIdx] = PRIMITIVE_RESTART_IDX;
-            eboIdx++;
-            vertexCount += vertCount + 1;
-        }
-
-        // Decrement EBO size to remove last PRIMITIVE_RESTART_IDX
-        eboIdx--;
-        vertexCount--;
-
-        AFW_ASSERT(eboIdx - eboOffset == vertexCount);
-        AFW_ASSERT(eboOffset + vertexCount < m_WorldEboBuf.size());
-
-        // Update EBO
-        m_WorldEbo.update(eboOffset * sizeof(uint16_t), vertexCount * sizeof(uint16_t),
-                          m_WorldEboBuf.data() + eboOffset);
-
-        // Draw elements
-        glDrawElements(GL_TRIANGLE_FAN, vertexCount, GL_UNSIGNED_SHORT,
-                       reinterpret_cast<const void *>(eboOffset * sizeof(uint16_t)));
+        // Draw surfaces
+        addSurfaceRanges(cmds, textureChain[i]);
+        cmds.drawRanges(RenderCommandBuffer::Primitive::TriangleFan);
 
         drawnSurfs += (unsigned)textureChain[i].size();
-        m_Renderer.m_Stats.uDrawCalls++;
     }
 
     m_Renderer.m_Stats.uWorldPolys += drawnSurfs;
 }
 
-void SceneRenderer::WorldRenderer::drawSkybox(WorldSurfaceList &surfList) {
+void SceneRenderer::WorldRenderer::drawSkybox(WorldSurfaceList &surfList,
+                                              RenderCommandBuffer &cmds) {
     AFW_ASSERT(m_Renderer.m_pSkyboxMaterial);
 
     if (surfList.skySurfaces.empty()) {
         return;
     }
 
-    // Set up GL
-    glBindVertexArray(m_Renderer.m_SurfaceVao);
-    m_WorldEbo.bind();
-    glDepthFunc(GL_LEQUAL);
-
-    // Bind material
-    const Material *mat = m_Renderer.m_pSkyboxMaterial;
-    mat->activateTextures();
-    mat->enableShader(SHADER_TYPE_WORLD_IDX, m_Renderer.m_uFrameCount);
-
-    // Fill the EBO
-    unsigned eboIdx = 0;
-    for (unsigned surfIdx : surfList.skySurfaces) {
-        Surface &surf = m_Renderer.m_Surfaces[surfIdx];
-        uint16_t vertCount = (uint16_t)surf.vertexCount;
-
-        for (uint16_t j = 0; j < vertCount; j++) {
-            m_WorldEboBuf[eboIdx + j] = (uint16_t)surf.vertexOffset + j;
-        }
-
-        eboIdx += vertCount;
-        m_WorldEboBuf[eboIdx] = PRIMITIVE_RESTART_IDX;
-        eboIdx++;
-    }
+    cmds.bindGeometry(RenderCommandBuffer::Geometry::Surfaces);
+    cmds.setDepthFunc(RenderCommandBuffer::DepthFunc::LessEqual);
+    cmds.enableMaterial(m_Renderer.m_pSkyboxMaterial, SHADER_TYPE_WORLD_IDX);
 
-    // Decrement EBO size to remove last PRIMITIVE_RESTART_IDX
-    eboIdx--;
-
-    // Update EBO
-    m_WorldEbo.update(0, eboIdx * sizeof(uint16_t), m_WorldEboBuf.data());
-
-    // Draw elements
-    glDrawElements(GL_TRIANGLE_FAN, eboIdx, GL_UNSIGNED_SHORT, nullptr);
+    // Draw surfaces
+    addSurfaceRanges(cmds, surfList.skySurfaces);
+    cmds.drawRanges(RenderCommandBuffer::Primitive::TriangleFan);
 
     m_Renderer.m_Stats.uSkyPolys += (unsigned)surfList.skySurfaces.size();
-    m_Renderer.m_Stats.uDrawCalls++;
 
-    // Restore GL
-    glDepthFunc(GL_LESS);
+    cmds.setDepthFunc(RenderCommandBuffer::DepthFunc::Less);
 }
 
-void SceneRenderer::WorldRenderer::drawWireframe(WorldSurfaceList &surfList, bool drawSky) {
+void SceneRenderer::WorldRenderer::drawWireframe(WorldSurfaceList &surfList, bool drawSky,
+                                                 RenderCommandBuffer &cmds) {
     auto &textureChain = surfList.textureChain;
     auto &textureChainFrames = surfList.textureChainFrames;
     unsigned frame = surfList.textureChainFrame;
-    
-    // Fill the EBO with world surfaces
-    unsigned eboIdx = 0;
 
+    // Add world surfaces
     for (size_t i = 0; i < textureChain.size(); i++) {
         if (textureChainFrames[i] != frame) {
             continue;
         }
 
-        for (unsigned surfIdx : textureChain[i]) {
-            Surface &surf = m_Renderer.m_Surfaces[surfIdx];
-            uint16_t vertCount = (uint16_t)surf.vertexCount;
-
-            for (uint16_t j = 0; j < vertCount; j++) {
-                m_WorldEboBuf[eboIdx + j] = (uint16_t)surf.vertexOffset + j;
-            }
-
-            eboIdx += vertCount;
-            m_WorldEboBuf[eboIdx] = PRIMITIVE_RESTART_IDX;
-            eboIdx++;
-        }
+        addSurfaceRanges(cmds, textureChain[i]);
     }
 
-    // Fill the EBO with sky surfaces
+    // Add sky surfaces
     if (drawSky) {
-        for (unsigned surfIdx : surfList.skySurfaces) {
-            Surface &surf = m_Renderer.m_Surfaces[surfIdx];
-            uint16_t vertCount = (uint16_t)surf.vertexCount;
-
-            for (uint16_t j = 0; j < vertCount; j++) {
-                m_WorldEboBuf[eboIdx + j] = (uint16_t)surf.vertexOffset + j;
-            }
-
-            eboIdx += vertCount;
-            m_WorldEboBuf[eboIdx] = PRIMITIVE_RESTART_IDX;
-            eboIdx++;
-        }
+        addSurfaceRanges(cmds, surfList.skySurfaces);
     }
 
-    if (eboIdx == 0) {
+    if (!cmds.hasPendingRanges()) {
         return;
     }
 
-    // Set up GL
-    glBindVertexArray(m_Renderer.m_SurfaceVao);
-    m_WorldEbo.bind();
-
-    // Enable shader
-    ShaderInstance *shaderInstance =
-        SceneShaders::Shaders::brushWireframe.getShaderInstance(SHADER_TYPE_CUSTOM_IDX);
-    shaderInstance->enable(m_Renderer.m_uFrameCount);
-    shaderInstance->getShader<SceneShaders::BrushWireframeShader>().setColor(glm::vec3(0.8f));
+    RenderCommandBuffer::Uniforms uniforms;
+    uniforms.vColor = glm::vec3(0.8f);
 
-    // Decrement EBO size to remove last PRIMITIVE_RESTART_IDX
-    eboIdx--;
+    cmds.bindGeometry(RenderCommandBuffer::Geometry::Surfaces);
+    cmds.enableWireframe();
+    cmds.setUniforms(RenderCommandBuffer::UniformSet::Wireframe, cmds.addUniforms(uniforms));
+    cmds.drawRanges(RenderCommandBuffer::Primitive::LineLoop);
+}
 
-    // Update EBO
-    m_WorldEbo.update(0, eboIdx * sizeof(uint16_t), m_WorldEboBuf.data());
+void SceneRenderer::WorldRenderer::setStaticModels(appfw::span<const Model *const> models) {
+    m_StaticModels.clear();
+    m_StaticModelLeaves.clear();
+
+    for (const Model *pModel : models) {
+        AFW_ASSERT(pModel->type == ModelType::Brush);
+        AFW_ASSERT(pModel->uFirstFace + pModel->uFaceNum <= m_Renderer.m_Surfaces.size());
+
+        StaticModel model;
+        model.vMins = pModel->vMins;
+        model.vMaxs = pModel->vMaxs;
+        model.iFirstSurface = pModel->uFirstFace;
+        model.iNumSurfaces = pModel->uFaceNum;
+        model.iFirstLeaf = (unsigned)m_StaticModelLeaves.size();
+        findBoxLeaves(0, model.vMins, model.vMaxs, m_StaticModelLeaves);
+        model.iNumLeaves = (unsigned)m_StaticModelLeaves.size() - model.iFirstLeaf;
+        m_StaticModels.push_back(model);
+    }
 
-    // Draw elements
-    glDrawElements(GL_LINE_LOOP, eboIdx, GL_UNSIGNED_SHORT, nullptr);
-    m_Renderer.m_Stats.uDrawCalls++;
+    // Surface lists need to be rebuilt
+    m_MainWorldSurfList.bIsReusable = false;
 }
 
 void SceneRenderer::WorldRenderer::createLeaves() {
@@ -240,6 +195,11 @@ void SceneRenderer::WorldRenderer::createNodes() {
         node.pPlane = &lvlPlanes.at(lvlNode.iPlane);
         node.iChildren[0] = lvlNode.iChildren[0];
         node.iChildren[1] = lvlNode.iChildren[1];
+
+        for (int j = 0; j < 3; j++) {
+            node.vMins[j] = lvlNode.nMins[j];
+            node.vMaxs[j] = lvlNode.nMaxs[j];
+        }
     }
 }
 
@@ -255,14 +215,46 @@ void SceneRenderer::WorldRenderer::updateNodeParents(int iNode, int parent) {
     }
 }
 
-void SceneRenderer::WorldRenderer::createBuffers() {
-    // Maximum ebo size is X vertices + Y primitive restarts.
-    // X = max vertex count, Y = max surface count.
-    unsigned maxEboSize = m_Renderer.m_uSurfaceVertexBufferSize + (unsigned)m_Renderer.m_Surfaces.size();
-    m_WorldEboBuf.resize(maxEboSize);
-    m_WorldEbo.create(GL_ELEMENT_ARRAY_BUFFER, "WorldRenderer: EBO");
-    m_WorldEbo.init(maxEboSize * sizeof(uint16_t), nullptr, GL_DYNAMIC_DRAW);
-    printi("WorldRenderer: EBO is {:.1f} KiB", m_WorldEbo.getMemUsage() / 1024.0);
+void SceneRenderer::WorldRenderer::findBoxLeaves(int nodeIdx, glm::vec3 mins, glm::vec3 maxs,
+                                                 std::vector<unsigned> &leaves) const {
+    while (nodeIdx >= 0) {
+        const Node &node = m_Nodes[nodeIdx];
+        const bsp::BSPPlane &plane = *node.pPlane;
+
+        // Distances of the nearest and the farthest corners of the box
+        float minDist = 0;
+        float maxDist = 0;
+
+        for (int i = 0; i < 3; i++) {
+            float n = plane.vNormal[i];
+            minDist += n * (n >= 0 ? mins[i] : maxs[i]);
+            maxDist += n * (n >= 0 ? maxs[i] : mins[i]);
+        }
+
+        if (minDist >= plane.fDist) {
+            // Front side only
+            nodeIdx = (int)node.iChildren[0];
+        } else if (maxDist < plane.fDist) {
+            // Back side only
+            nodeIdx = (int)node.iChildren[1];
+        } else {
+            findBoxLeaves((int)node.iChildren[0], mins, maxs, leaves);
+            nodeIdx = (int)node.iChildren[1];
+        }
+    }
+
+    // Leaf 0 is the solid leaf, it's never visible
+    if (nodeIdx != -1) {
+        leaves.push_back((unsigned)~nodeIdx);
+    }
+}
+
+void SceneRenderer::WorldRenderer::addSurfaceRanges(RenderCommandBuffer &cmds,
+                                                    const std::vector<unsigned> &surfaces) const {
+    for (unsigned surfIdx : surfaces) {
+        const Surface &surf = m_Renderer.m_Surfaces[surfIdx];
+        cmds.addRange(surf.vertexOffset, surf.vertexCount);
+    }
 }
 
 void SceneRenderer::WorldRenderer::markLeaves(ViewContext &context,
@@ -324,50 +316,116 @@ void SceneRenderer::WorldRenderer::markLeaves(ViewContext &context,
     }
 }
 
-void SceneRenderer::WorldRenderer::recursiveWorldNodesTextured(ViewContext &context,
-                                                               WorldSurfaceList &surfList,
-                                                               int nodeIdx) const {
-    if (nodeIdx < 0) {
-        // Leaf
-        return;
+void SceneRenderer::WorldRenderer::traverseWorldNodesTextured(ViewContext &context,
+                                                              WorldSurfaceList &surfList) const {
+    auto &stack = surfList.nodeStack;
+    stack.clear();
+    stack.push_back({0, ViewContext::FRUSTUM_ALL_PLANES, false});
+
+    while (!stack.empty()) {
+        NodeStackItem item = stack.back();
+        stack.pop_back();
+
+        if (item.iNode < 0) {
+            // Leaf
+            continue;
+        }
+
+        const Node &node = m_Nodes[item.iNode];
+
+        if (item.bDrawSurfaces) {
+            addSurfaces(context, surfList, node.iFirstSurface, node.iNumSurfaces,
+                        item.uPlaneMask);
+            continue;
+        }
+
+        if (surfList.nodeVisFrame[item.iNode] != surfList.visFrame) {
+            // Not in PVS
+            continue;
+        }
+
+        unsigned planeMask = item.uPlaneMask;
+
+        if (planeMask != 0 && context.cullBox(node.vMins, node.vMaxs, planeMask)) {
+            // Outside of the frustum
+            continue;
+        }
+
+        float dot = planeDiff(context.getViewOrigin(), *node.pPlane);
+        int side = (dot >= 0.0f) ? 0 : 1;
+
+        // Pushed in reverse order: front side, surfaces of current node, back side
+        stack.push_back({(int)node.iChildren[!side], planeMask, false});
+
+        if (node.iNumSurfaces != 0) {
+            stack.push_back({item.iNode, planeMask, true});
+        }
+
+        stack.push_back({(int)node.iChildren[side], planeMask, false});
     }
 
-    if (surfList.nodeVisFrame[nodeIdx] != surfList.visFrame) {
-        // Not in PVS
-        return;
+    if (surfList.bHasStaticModels) {
+        addStaticModelSurfaces(context, surfList);
     }
+}
 
-    const Node &node = m_Nodes[nodeIdx];
+void SceneRenderer::WorldRenderer::addStaticModelSurfaces(ViewContext &context,
+                                                          WorldSurfaceList &surfList) const {
+    for (const StaticModel &model : m_StaticModels) {
+        bool isInPVS = false;
 
-    float dot = planeDiff(context.getViewOrigin(), *node.pPlane);
-    int side = (dot >= 0.0f) ? 0 : 1;
+        for (unsigned i = 0; i < model.iNumLeaves; i++) {
+            unsigned leafIdx = m_StaticModelLeaves[model.iFirstLeaf + i];
 
-    // Front side
-    recursiveWorldNodesTextured(context, surfList, node.iChildren[side]);
+            if (surfList.leafVisFrame[leafIdx] == surfList.visFrame) {
+                isInPVS = true;
+                break;
+            }
+        }
 
-    // Draw surfaces of current node
-    for (unsigned i = 0; i < node.iNumSurfaces; i++) {
-        unsigned idx = node.iFirstSurface + i;
-        Surface &surf = m_Renderer.m_Surfaces[idx];
+        if (!isInPVS) {
+            continue;
+        }
+
+        unsigned planeMask = ViewContext::FRUSTUM_ALL_PLANES;
 
-        if (context.cullSurface(surf)) {
+        if (context.cullBox(model.vMins, model.vMaxs, planeMask)) {
             continue;
         }
 
-        if (surf.flags & SURF_DRAWSKY) {
-            surfList.skySurfaces.push_back(idx);
-        } else {
-            unsigned matIdx = surf.materialIdx;
-            unsigned oldChainFrame = surfList.textureChainFrames[matIdx];
-            if (oldChainFrame != surfList.textureChainFrame) {
-                surfList.textureChainFrames[matIdx] = surfList.textureChainFrame;
-                surfList.textureChain[matIdx].clear();
+        addSurfaces(context, surfList, model.iFirstSurface, model.iNumSurfaces, planeMask);
+    }
+}
+
+void SceneRenderer::WorldRenderer::addSurfaces(ViewContext &context, WorldSurfaceList &surfList,
+                                               unsigned first, unsigned count,
+                                               unsigned planeMask) const {
+    for (unsigned base = 0; base < count; base += CULL_BATCH_SIZE) {
+        unsigned batchCount = std::min(count - base, CULL_BATCH_SIZE);
+        uint32_t visMask[CULL_BATCH_SIZE / 32];
+        context.cullSurfaces(m_Renderer.m_SurfaceCullData, first + base, batchCount, visMask,
+                             planeMask);
+
+        for (unsigned i = 0; i < batchCount; i++) {
+            if (!(visMask[i / 32] & (1u << (i % 32)))) {
+                continue;
             }
 
-            surfList.textureChain[matIdx].push_back(idx);
+            unsigned idx = first + base + i;
+            Surface &surf = m_Renderer.m_Surfaces[idx];
+
+            if (surf.flags & SURF_DRAWSKY) {
+                surfList.skySurfaces.push_back(idx);
+            } else {
+                unsigned matIdx = surf.materialIdx;
+                unsigned oldChainFrame = surfList.textureChainFrames[matIdx];
+                if (oldChainFrame != surfList.textureChainFrame) {
+                    surfList.textureChainFrames[matIdx] = surfList.textureChainFrame;
+                    surfList.textureChain[matIdx].clear();
+                }
+
+                surfList.textureChain[matIdx].push_back(idx);
+            }
         }
     }
-
-    // Back side
-    recursiveWorldNodesTextured(context, surfList, node.iChildren[!side]);
 }
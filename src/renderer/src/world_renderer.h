@@ -4,6 +4,12 @@
 
 class SceneRenderer::WorldRenderer {
 public:
+    struct NodeStackItem {
+        int iNode = 0;
+        unsigned uPlaneMask = 0;    //!< Frustum planes the node needs to be tested against
+        bool bDrawSurfaces = false; //!< Add surfaces of the node instead of visiting it
+    };
+
     struct WorldSurfaceList {
         std::vector<std::vector<unsigned>> textureChain;
         std::vector<unsigned> textureChainFrames;
@@ -14,30 +20,53 @@ public:
         int viewLeaf = 0;                   //!< Index of view origin leaf
         std::vector<unsigned> nodeVisFrame; //!< Visframes of nodes
         std::vector<unsigned> leafVisFrame; //!< Visframes of leaves
+        std::vector<NodeStackItem> nodeStack; //!< BSP traversal stack
+        bool bHasStaticModels = false;        //!< Static models were added (r_drawents)
+
+        // Reuse of the lists between frames
+        bool bIsReusable = false;        //!< Lists were built for reuseContext
+        ViewContext reuseContext;        //!< Padded view context the lists were built for
+        unsigned reuseVisFrame = 0;      //!< Visframe the lists were built for
+        unsigned reuseMaterialCount = 0; //!< Number of materials when the lists were built
     };
 
     WorldRenderer(SceneRenderer &renderer);
 
     //! Puts visible surfaces into surfList. Make sure to keep it to reduce reallocations.
+    //! The lists are built for a slightly enlarged frustum and kept while the view stays close to
+    //! the one they were built for.
     //! surfList.textureChain[i] contains a list of surfaces with texture i.
     //! surfList.textureChainFrames[i] contains the frame at which it was drawn.
     //! Texture chain i must only be drawn if its frame == surfList.textureChainFrame.
     //! surfList.skySurfaces contains list of sky surfaces.
     void getTexturedWorldSurfaces(ViewContext &context, WorldSurfaceList &surfList) const;
 
-    //! Renders the world, performs batching.
-    void drawTexturedWorld(WorldSurfaceList &surfList);
+    //! Records commands that render the world, one draw per texture chain.
+    void drawTexturedWorld(WorldSurfaceList &surfList, RenderCommandBuffer &cmds);
+
+    //! Records commands that render the sky polygons in one batch.
+    void drawSkybox(WorldSurfaceList &surfList, RenderCommandBuffer &cmds);
+
+    //! Records commands that render world and sky polygons as wireframe.
+    void drawWireframe(WorldSurfaceList &surfList, bool drawSky, RenderCommandBuffer &cmds);
 
-    //! Renders the sky polygons in one batch.
-    void drawSkybox(WorldSurfaceList &surfList);
-    
-    //! Renders world and sky polygons as wireframe.
-    void drawWireframe(WorldSurfaceList &surfList, bool drawSky);
+    //! Sets brush models that are drawn as a part of the world.
+    //! They must never move and use normal render mode.
+    void setStaticModels(appfw::span<const Model *const> models);
 
     //! Surf list for main view
     WorldSurfaceList m_MainWorldSurfList;
 
 private:
+    //! Number of surfaces culled at once.
+    static constexpr unsigned CULL_BATCH_SIZE = 256;
+
+    //! How far the view can move before reusable surface lists are rebuilt.
+    static constexpr float REUSE_DIST_MARGIN = 16.0f;
+
+    //! How much the view can rotate (in degrees) before reusable surface lists are rebuilt.
+    static constexpr float REUSE_ANGLE_MARGIN = 3.0f;
+
     struct BaseNode {
         int nContents = 0;
         unsigned iParentIdx = 0;
@@ -48,32 +77,52 @@ private:
         unsigned iNumSurfaces = 0;
         const bsp::BSPPlane *pPlane = nullptr;
         unsigned iChildren[2];
+        glm::vec3 vMins, vMaxs;
     };
 
     struct Leaf : public BaseNode {
         const uint8_t *pCompressedVis = nullptr;
     };
 
+    struct StaticModel {
+        glm::vec3 vMins, vMaxs;
+        unsigned iFirstSurface = 0;
+        unsigned iNumSurfaces = 0;
+        unsigned iFirstLeaf = 0; //!< Index in m_StaticModelLeaves
+        unsigned iNumLeaves = 0;
+    };
+
     // World info
     SceneRenderer &m_Renderer;
     std::vector<Node> m_Nodes;
     std::vector<Leaf> m_Leaves;
-
-    // Rendering info
-    GPUBuffer m_WorldEbo;
-    std::vector<uint16_t> m_WorldEboBuf;
+    std::vector<StaticModel> m_StaticModels;
+    std::vector<unsigned> m_StaticModelLeaves; //!< Leaves touched by static models
 
     void createLeaves();
     void createNodes();
     void updateNodeParents(int iNode, int parent);
-    void createBuffers();
+
+    //! Adds vertex ranges of surfaces to the command buffer.
+    void addSurfaceRanges(RenderCommandBuffer &cmds, const std::vector<unsigned> &surfaces) const;
 
     //! Goes over all visible leaves and nodes and sets their visframes to current visframe.
     void markLeaves(ViewContext &context, WorldSurfaceList &surfList) const;
 
     //! Traverses BSP tree and puts visible surfaces into the surf list. Order is front to back.
-    void recursiveWorldNodesTextured(ViewContext &context, WorldSurfaceList &surfList,
-                                     int node) const;
+    //! Nodes outside of the frustum are skipped with all their children.
+    void traverseWorldNodesTextured(ViewContext &context, WorldSurfaceList &surfList) const;
+
+    //! Puts visible surfaces of static models into the surf list.
+    void addStaticModelSurfaces(ViewContext &context, WorldSurfaceList &surfList) const;
+
+    //! Puts visible surfaces [first; first + count) into the surf list.
+    void addSurfaces(ViewContext &context, WorldSurfaceList &surfList, unsigned first,
+                     unsigned count, unsigned planeMask) const;
+
+    //! Finds all leaves that the box touches.
+    void findBoxLeaves(int nodeIdx, glm::vec3 mins, glm::vec3 maxs,
+                       std::vector<unsigned> &leaves) const;
 };
 
 #endif
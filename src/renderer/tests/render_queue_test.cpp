@@ -0,0 +1,111 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <renderer/render_queue.h>
+
+namespace {
+
+int s_iFailCount = 0;
+
+void check(bool value, const char *what, size_t size) {
+    if (!value) {
+        printf("FAILED: %s (size %zu)\n", what, size);
+        s_iFailCount++;
+    }
+}
+
+//! Compares RenderQueue::sort with std::stable_sort on random keys.
+void testSort(std::mt19937 &rng, size_t size, RenderQueue::DepthOrder order) {
+    // Few distinct values so that equal fields and keys are common
+    static const float DEPTHS[] = {-1000.0f, -2.5f, -1.0f, -0.0f, 0.0f, 0.5f, 1.0f, 3e8f};
+    std::uniform_int_distribution<unsigned> fieldDist(0, 3);
+    std::uniform_int_distribution<size_t> depthDist(0, std::size(DEPTHS) - 1);
+
+    RenderQueue queue;
+    std::vector<RenderQueue::Item> expected;
+
+    for (size_t i = 0; i < size; i++) {
+        uint64_t key = RenderQueue::makeKey(fieldDist(rng), fieldDist(rng), fieldDist(rng),
+                                            DEPTHS[depthDist(rng)], order);
+        queue.add(key, (uint32_t)i);
+        expected.push_back({key, (uint32_t)i});
+    }
+
+    queue.sort();
+    std::stable_sort(expected.begin(), expected.end(),
+                     [](const RenderQueue::Item &lhs, const RenderQueue::Item &rhs) {
+                         return lhs.uKey < rhs.uKey;
+                     });
+
+    bool isEqual = queue.size() == expected.size();
+
+    for (size_t i = 0; isEqual && i < size; i++) {
+        isEqual = queue[i].uKey == expected[i].uKey && queue[i].uIndex == expected[i].uIndex;
+    }
+
+    check(isEqual, "sort matches std::stable_sort", size);
+}
+
+//! Checks that keys order depths as requested.
+void testDepthOrder() {
+    static const float DEPTHS[] = {-1e30f, -1000.0f, -1.0f, -1e-30f, 0.0f, 1e-30f, 1.0f, 1e30f};
+
+    for (size_t i = 1; i < std::size(DEPTHS); i++) {
+        float nearer = DEPTHS[i - 1];
+        float farther = DEPTHS[i];
+
+        check(RenderQueue::floatToSortable(nearer) < RenderQueue::floatToSortable(farther),
+              "floatToSortable keeps order", i);
+        check(RenderQueue::makeKey(0, 0, 0, nearer, RenderQueue::DepthOrder::FrontToBack) <
+                  RenderQueue::makeKey(0, 0, 0, farther, RenderQueue::DepthOrder::FrontToBack),
+              "front to back", i);
+        check(RenderQueue::makeKey(0, 0, 0, farther, RenderQueue::DepthOrder::BackToFront) <
+                  RenderQueue::makeKey(0, 0, 0, nearer, RenderQueue::DepthOrder::BackToFront),
+              "back to front", i);
+    }
+
+    // Higher fields take priority over depth
+    check(RenderQueue::makeKey(0, 1, 0, 1e30f, RenderQueue::DepthOrder::FrontToBack) <
+              RenderQueue::makeKey(1, 0, 0, -1e30f, RenderQueue::DepthOrder::FrontToBack),
+          "pass is above shader", 0);
+}
+
+} // namespace
+
+int main() {
+    std::mt19937 rng(12345);
+    static const size_t SIZES[] = {0, 1, 2, 5, 31, 32, 33, 100, 1000, 10000};
+
+    for (size_t size : SIZES) {
+        for (int i = 0; i < 10; i++) {
+            testSort(rng, size, RenderQueue::DepthOrder::FrontToBack);
+            testSort(rng, size, RenderQueue::DepthOrder::BackToFront);
+        }
+    }
+
+    // All keys are equal, every radix pass is skipped
+    RenderQueue queue;
+
+    for (uint32_t i = 0; i < 100; i++) {
+        queue.add(42, i);
+    }
+
+    queue.sort();
+    bool isStable = true;
+
+    for (uint32_t i = 0; i < 100; i++) {
+        isStable = isStable && queue[i].uIndex == i;
+    }
+
+    check(isStable, "equal keys keep their order", queue.size());
+
+    testDepthOrder();
+
+    if (s_iFailCount != 0) {
+        printf("%d checks failed\n", s_iFailCount);
+        return 1;
+    }
+
+    printf("All checks passed\n");
+    return 0;
+}